@@ -0,0 +1,701 @@
+#include "BspBvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#ifdef __SSE__
+#   include <xmmintrin.h>
+#endif
+
+namespace Decay::Bsp::v30
+{
+    namespace
+    {
+        constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+        struct Bounds
+        {
+            glm::vec3 Min = glm::vec3(Infinity);
+            glm::vec3 Max = glm::vec3(-Infinity);
+
+            inline void Grow(const glm::vec3& point)
+            {
+                Min = glm::min(Min, point);
+                Max = glm::max(Max, point);
+            }
+            inline void Grow(const Bounds& other)
+            {
+                Min = glm::min(Min, other.Min);
+                Max = glm::max(Max, other.Max);
+            }
+            /// Half of the surface area, only used for comparison
+            [[nodiscard]] inline float Area() const
+            {
+                const glm::vec3 e = Max - Min;
+                return e.x * e.y + e.y * e.z + e.z * e.x;
+            }
+        };
+
+        struct BuildTriangle
+        {
+            Bounds Box;
+            glm::vec3 Center;
+        };
+
+        /// Top-down binned SAH build.
+        /// Nodes are preallocated (2N - 1 is the maximum for N triangles), children are reserved in pairs by an atomic counter
+        /// and every subtree partitions only its own range of `Order` - so subtrees can be built by separate threads.
+        class Builder
+        {
+        public:
+            Builder(std::vector<BspBvh::Node>& nodes, const std::vector<BuildTriangle>& triangles, std::vector<uint32_t>& order, std::size_t threadCount)
+              : Nodes(nodes), Triangles(triangles), Order(order), FreeThreads(threadCount > 0 ? threadCount - 1 : 0)
+            {
+            }
+
+        public:
+            /// Smaller subtrees are not worth a new thread
+            static const uint32_t ParallelThreshold = 1u << 14u;
+
+            std::vector<BspBvh::Node>& Nodes;
+            const std::vector<BuildTriangle>& Triangles;
+            std::vector<uint32_t>& Order;
+
+            std::atomic<uint32_t> NodeCount = 1;
+            std::atomic<std::size_t> FreeThreads;
+
+        public:
+            void Build(uint32_t nodeIndex, uint32_t first, uint32_t count, std::size_t depth)
+            {
+                BspBvh::Node& node = Nodes[nodeIndex];
+
+                Bounds bounds, centers;
+                for(uint32_t i = first; i < first + count; i++)
+                {
+                    const BuildTriangle& triangle = Triangles[Order[i]];
+                    bounds.Grow(triangle.Box);
+                    centers.Grow(triangle.Center);
+                }
+                // Slightly larger, so rays lying exactly on a face of the box (parallel to it) still enter it
+                node.Min = bounds.Min - glm::vec3(BspBvh::BoxEpsilon);
+                node.Max = bounds.Max + glm::vec3(BspBvh::BoxEpsilon);
+                node.LeftFirst = first;
+                node.Count = count;
+
+                if(count <= BspBvh::MinLeafSize || depth + 1 >= BspBvh::MaxDepth)
+                    return;
+
+                // Find the cheapest split on bin borders of all axes
+                float bestCost = Infinity;
+                int bestAxis = -1;
+                std::size_t bestSplit = 0;
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    const float extent = centers.Max[axis] - centers.Min[axis];
+                    if(extent <= 0)
+                        continue;
+                    const float scale = BspBvh::BinCount / extent;
+
+                    Bounds bins[BspBvh::BinCount];
+                    uint32_t binCounts[BspBvh::BinCount] = {};
+                    for(uint32_t i = first; i < first + count; i++)
+                    {
+                        const BuildTriangle& triangle = Triangles[Order[i]];
+                        const std::size_t bin = GetBin(triangle.Center[axis], centers.Min[axis], scale);
+                        bins[bin].Grow(triangle.Box);
+                        binCounts[bin]++;
+                    }
+
+                    // Left sides from the start, right sides from the end
+                    float leftArea[BspBvh::BinCount - 1];
+                    uint32_t leftCount[BspBvh::BinCount - 1];
+                    {
+                        Bounds left;
+                        uint32_t sum = 0;
+                        for(std::size_t b = 0; b < BspBvh::BinCount - 1; b++)
+                        {
+                            left.Grow(bins[b]);
+                            sum += binCounts[b];
+                            leftArea[b] = left.Area();
+                            leftCount[b] = sum;
+                        }
+                    }
+                    Bounds right;
+                    uint32_t rightCount = 0;
+                    for(std::size_t b = BspBvh::BinCount - 1; b > 0; b--)
+                    {
+                        right.Grow(bins[b]);
+                        rightCount += binCounts[b];
+                        if(leftCount[b - 1] == 0 || rightCount == 0)
+                            continue;
+
+                        const float cost = leftArea[b - 1] * leftCount[b - 1] + right.Area() * rightCount;
+                        if(cost < bestCost)
+                        {
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestSplit = b;
+                        }
+                    }
+                }
+
+                // All centers are in one point
+                if(bestAxis < 0)
+                    return;
+
+                // Traversal and intersection costs are both 1
+                const float nodeArea = bounds.Area();
+                if(nodeArea + bestCost >= nodeArea * count && count <= BspBvh::MaxLeafSize)
+                    return;
+
+                const float binMin = centers.Min[bestAxis];
+                const float binScale = BspBvh::BinCount / (centers.Max[bestAxis] - binMin);
+                const auto middle = std::partition(
+                    Order.begin() + first,
+                    Order.begin() + first + count,
+                    [&](uint32_t triangle) { return GetBin(Triangles[triangle].Center[bestAxis], binMin, binScale) < bestSplit; }
+                );
+                const auto leftCount = static_cast<uint32_t>(middle - (Order.begin() + first));
+                if(leftCount == 0 || leftCount == count) [[unlikely]]
+                    return;
+
+                const uint32_t children = NodeCount.fetch_add(2, std::memory_order_relaxed);
+                node.LeftFirst = children;
+                node.Count = 0;
+
+                if(count >= ParallelThreshold && TakeThread())
+                {
+                    // Exceptions of both subtrees are rethrown after both finished
+                    ParallelFor(2, 2, [this, children, first, leftCount, count, depth](std::size_t side, std::size_t)
+                    {
+                        if(side == 0)
+                            Build(children, first, leftCount, depth + 1);
+                        else
+                            Build(children + 1, first + leftCount, count - leftCount, depth + 1);
+                    });
+                    FreeThreads.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    Build(children, first, leftCount, depth + 1);
+                    Build(children + 1, first + leftCount, count - leftCount, depth + 1);
+                }
+            }
+
+        private:
+            [[nodiscard]] static inline std::size_t GetBin(float center, float min, float scale)
+            {
+                return std::min(BspBvh::BinCount - 1, static_cast<std::size_t>((center - min) * scale));
+            }
+
+            bool TakeThread()
+            {
+                std::size_t free = FreeThreads.load(std::memory_order_relaxed);
+                while(free > 0)
+                {
+                    if(FreeThreads.compare_exchange_weak(free, free - 1, std::memory_order_relaxed))
+                        return true;
+                }
+                return false;
+            }
+        };
+
+        inline glm::vec3 SafeInverse(const glm::vec3& direction)
+        {
+            // Zero would result in NaN when the origin lies on a slab
+            glm::vec3 inverse;
+            for(int axis = 0; axis < 3; axis++)
+            {
+                const float d = direction[axis];
+                inverse[axis] = 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+            }
+            return inverse;
+        }
+
+        /// Distance of entering the box, or infinity when missed (or further than `maxDistance`)
+        inline float IntersectBox(const BspBvh::Node& node, const glm::vec3& origin, const glm::vec3& inverse, float maxDistance)
+        {
+            const glm::vec3 t1 = (node.Min - origin) * inverse;
+            const glm::vec3 t2 = (node.Max - origin) * inverse;
+            const glm::vec3 tMin = glm::min(t1, t2);
+            const glm::vec3 tMax = glm::max(t1, t2);
+
+            const float tNear = std::max(std::max(tMin.x, tMin.y), tMin.z);
+            const float tFar = std::min(std::min(tMax.x, tMax.y), tMax.z);
+            if(tFar >= tNear && tFar >= 0 && tNear < maxDistance)
+                return tNear;
+            return Infinity;
+        }
+
+        /// Möller-Trumbore, both sides of the triangle
+        inline bool IntersectTriangle(const BspBvh::Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float& t, float& u, float& v)
+        {
+            const glm::vec3 p = glm::cross(direction, triangle.Edge2);
+            const float det = glm::dot(triangle.Edge1, p);
+            if(std::abs(det) < 1e-12f)
+                return false;
+            const float inverseDet = 1.0f / det;
+
+            const glm::vec3 s = origin - triangle.V0;
+            u = glm::dot(s, p) * inverseDet;
+            if(u < 0 || u > 1)
+                return false;
+
+            const glm::vec3 q = glm::cross(s, triangle.Edge1);
+            v = glm::dot(direction, q) * inverseDet;
+            if(v < 0 || u + v > 1)
+                return false;
+
+            t = glm::dot(triangle.Edge2, q) * inverseDet;
+            return t >= 0;
+        }
+
+        /// Separating axis test (Akenine-Möller)
+        bool TriangleOverlapsBox(const BspBvh::Triangle& triangle, const glm::vec3& boxCenter, const glm::vec3& boxHalf)
+        {
+            const glm::vec3 v[3] = {
+                triangle.V0 - boxCenter,
+                triangle.V0 + triangle.Edge1 - boxCenter,
+                triangle.V0 + triangle.Edge2 - boxCenter
+            };
+
+            // Box axes
+            for(int axis = 0; axis < 3; axis++)
+            {
+                const float min = std::min(std::min(v[0][axis], v[1][axis]), v[2][axis]);
+                const float max = std::max(std::max(v[0][axis], v[1][axis]), v[2][axis]);
+                if(min > boxHalf[axis] || max < -boxHalf[axis])
+                    return false;
+            }
+
+            // Triangle normal
+            const glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[1]);
+            if(std::abs(glm::dot(normal, v[0])) > glm::dot(boxHalf, glm::abs(normal)))
+                return false;
+
+            // Cross products of box axes and triangle edges
+            const glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+            for(const glm::vec3& edge : edges)
+            {
+                for(int axis = 0; axis < 3; axis++)
+                {
+                    glm::vec3 unit(0);
+                    unit[axis] = 1;
+                    const glm::vec3 separating = glm::cross(unit, edge);
+
+                    const float p0 = glm::dot(v[0], separating);
+                    const float p1 = glm::dot(v[1], separating);
+                    const float p2 = glm::dot(v[2], separating);
+                    const float r = glm::dot(boxHalf, glm::abs(separating));
+                    if(std::min(std::min(p0, p1), p2) > r || std::max(std::max(p0, p1), p2) < -r)
+                        return false;
+                }
+            }
+
+            return true;
+        }
+
+        /// Closest point on triangle (Ericson, Real-Time Collision Detection)
+        glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+        {
+            const glm::vec3 ab = b - a;
+            const glm::vec3 ac = c - a;
+
+            const glm::vec3 ap = p - a;
+            const float d1 = glm::dot(ab, ap);
+            const float d2 = glm::dot(ac, ap);
+            if(d1 <= 0 && d2 <= 0)
+                return a;
+
+            const glm::vec3 bp = p - b;
+            const float d3 = glm::dot(ab, bp);
+            const float d4 = glm::dot(ac, bp);
+            if(d3 >= 0 && d4 <= d3)
+                return b;
+
+            const float vc = d1 * d4 - d3 * d2;
+            if(vc <= 0 && d1 >= 0 && d3 <= 0)
+                return a + ab * (d1 / (d1 - d3));
+
+            const glm::vec3 cp = p - c;
+            const float d5 = glm::dot(ab, cp);
+            const float d6 = glm::dot(ac, cp);
+            if(d6 >= 0 && d5 <= d6)
+                return c;
+
+            const float vb = d5 * d2 - d1 * d6;
+            if(vb <= 0 && d2 >= 0 && d6 <= 0)
+                return a + ac * (d2 / (d2 - d6));
+
+            const float va = d3 * d6 - d5 * d4;
+            if(va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+                return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+            const float denom = 1.0f / (va + vb + vc);
+            return a + ab * (vb * denom) + ac * (vc * denom);
+        }
+
+        void SortUniqueFaces(std::vector<BspBvh::TriangleInfo>& faces)
+        {
+            std::sort(faces.begin(), faces.end(), [](const BspBvh::TriangleInfo& a, const BspBvh::TriangleInfo& b)
+            {
+                return a.Face != b.Face ? a.Face < b.Face : a.Model < b.Model;
+            });
+            faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+        }
+    }
+
+    BspBvh::BspBvh(const BspTree& tree, std::size_t threadCount)
+    {
+        // Collect triangles of all models
+        std::vector<Triangle> triangles;
+        std::vector<TriangleInfo> triangleInfo;
+        std::vector<BuildTriangle> buildTriangles;
+        for(std::size_t mi = 0; mi < tree.Models.size(); mi++)
+        {
+            const BspTree::Model& model = *tree.Models[mi];
+            const auto vertices = tree.GetModelVertices(model);
+            const auto& indices = model.Indices;
+            R_ASSERT(model.TriangleFaces.size() * 3 == indices.size(), "Model " << mi << " does not have face for every triangle");
+            for(const auto& range : model.TextureRanges)
+            {
+                for(std::size_t ti = range.Offset / 3; ti < (range.Offset + range.Count) / 3; ti++)
+                {
+                    const glm::vec3& a = vertices[indices[ti * 3 + 0]].Position;
+                    const glm::vec3& b = vertices[indices[ti * 3 + 1]].Position;
+                    const glm::vec3& c = vertices[indices[ti * 3 + 2]].Position;
+
+                    triangles.push_back({ a, b - a, c - a });
+                    triangleInfo.push_back({ model.TriangleFaces[ti], range.TextureId, static_cast<uint16_t>(mi) });
+
+                    BuildTriangle& build = buildTriangles.emplace_back();
+                    build.Box.Grow(a);
+                    build.Box.Grow(b);
+                    build.Box.Grow(c);
+                    build.Center = (build.Box.Min + build.Box.Max) * 0.5f;
+                }
+            }
+        }
+        if(triangles.empty())
+            return;
+
+        std::vector<uint32_t> order(triangles.size());
+        for(std::size_t i = 0; i < order.size(); i++)
+            order[i] = static_cast<uint32_t>(i);
+
+        if(threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        m_Nodes.resize(triangles.size() * 2 - 1);
+        Builder builder(m_Nodes, buildTriangles, order, threadCount);
+        builder.Build(0, 0, static_cast<uint32_t>(triangles.size()), 0);
+        m_Nodes.resize(builder.NodeCount.load());
+        m_Nodes.shrink_to_fit();
+
+        // Leaves point into continuous ranges of triangles
+        m_Triangles.resize(triangles.size());
+        m_TriangleInfo.resize(triangles.size());
+        for(std::size_t i = 0; i < order.size(); i++)
+        {
+            m_Triangles[i] = triangles[order[i]];
+            m_TriangleInfo[i] = triangleInfo[order[i]];
+        }
+    }
+
+    template<bool AnyHit>
+    bool BspBvh::IntersectSingle(const Ray& ray, Hit& hit) const
+    {
+        if(m_Nodes.empty())
+            return false;
+
+        const glm::vec3 inverse = SafeInverse(ray.Direction);
+        if(IntersectBox(m_Nodes[0], ray.Origin, inverse, hit.Distance) == Infinity)
+            return false;
+
+        bool found = false;
+        uint32_t stack[MaxDepth];
+        std::size_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+        while(true)
+        {
+            const Node& node = m_Nodes[nodeIndex];
+            if(node.IsLeaf())
+            {
+                for(uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+                {
+                    float t, u, v;
+                    if(IntersectTriangle(m_Triangles[i], ray.Origin, ray.Direction, t, u, v) && t < hit.Distance)
+                    {
+                        hit.Distance = t;
+                        hit.Barycentric = glm::vec2(u, v);
+                        hit.Triangle = i;
+                        found = true;
+
+                        if constexpr(AnyHit)
+                            return true;
+                    }
+                }
+            }
+            else
+            {
+                // Closer child first, the other one waits on the stack
+                uint32_t nearChild = node.LeftFirst, farChild = node.LeftFirst + 1;
+                float nearDistance = IntersectBox(m_Nodes[nearChild], ray.Origin, inverse, hit.Distance);
+                float farDistance = IntersectBox(m_Nodes[farChild], ray.Origin, inverse, hit.Distance);
+                if(nearDistance > farDistance)
+                {
+                    std::swap(nearChild, farChild);
+                    std::swap(nearDistance, farDistance);
+                }
+
+                if(nearDistance != Infinity)
+                {
+                    if(farDistance != Infinity)
+                        stack[stackSize++] = farChild;
+                    nodeIndex = nearChild;
+                    continue;
+                }
+            }
+
+            if(stackSize == 0)
+                break;
+            nodeIndex = stack[--stackSize];
+        }
+
+        return found;
+    }
+
+    BspBvh::Hit BspBvh::Intersect(const Ray& ray) const
+    {
+        Hit hit = {};
+        hit.Distance = ray.MaxDistance;
+        if(!IntersectSingle<false>(ray, hit))
+            return {};
+
+        hit.Info = m_TriangleInfo[hit.Triangle];
+        return hit;
+    }
+    void BspBvh::Intersect(std::span<const Ray> rays, std::span<Hit> hits) const
+    {
+        R_ASSERT(hits.size() >= rays.size(), "Output is smaller than the number of rays");
+
+        for(std::size_t first = 0; first < rays.size(); first += PacketSize)
+        {
+            const std::size_t count = std::min(PacketSize, rays.size() - first);
+            IntersectPacket(rays.subspan(first, count), hits.subspan(first, count));
+        }
+    }
+    void BspBvh::IntersectPacket(std::span<const Ray> rays, std::span<Hit> hits) const
+    {
+        static_assert(PacketSize == 4, "Packet is made for 4-wide SIMD");
+
+        // Lanes are stored by component, unused lanes can never hit (negative max distance)
+        alignas(16) float originX[PacketSize] = {}, originY[PacketSize] = {}, originZ[PacketSize] = {};
+        alignas(16) float inverseX[PacketSize] = {}, inverseY[PacketSize] = {}, inverseZ[PacketSize] = {};
+        alignas(16) float distance[PacketSize] = { -1, -1, -1, -1 };
+        glm::vec3 directionSum(0);
+        for(std::size_t lane = 0; lane < rays.size(); lane++)
+        {
+            const Ray& ray = rays[lane];
+            const glm::vec3 inverse = SafeInverse(ray.Direction);
+
+            originX[lane] = ray.Origin.x;
+            originY[lane] = ray.Origin.y;
+            originZ[lane] = ray.Origin.z;
+            inverseX[lane] = inverse.x;
+            inverseY[lane] = inverse.y;
+            inverseZ[lane] = inverse.z;
+            distance[lane] = ray.MaxDistance;
+            directionSum += ray.Direction;
+
+            hits[lane] = {};
+        }
+
+        // Does any ray of the packet hit the node
+        const auto hitsNode = [&](const Node& node) -> bool
+        {
+#ifdef __SSE__
+            const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min.x), _mm_load_ps(originX)), _mm_load_ps(inverseX));
+            const __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max.x), _mm_load_ps(originX)), _mm_load_ps(inverseX));
+            const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min.y), _mm_load_ps(originY)), _mm_load_ps(inverseY));
+            const __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max.y), _mm_load_ps(originY)), _mm_load_ps(inverseY));
+            const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Min.z), _mm_load_ps(originZ)), _mm_load_ps(inverseZ));
+            const __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.Max.z), _mm_load_ps(originZ)), _mm_load_ps(inverseZ));
+
+            const __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_min_ps(t1z, t2z));
+            const __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_max_ps(t1z, t2z));
+
+            const __m128 mask = _mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(tFar, tNear), _mm_cmpge_ps(tFar, _mm_setzero_ps())),
+                _mm_cmplt_ps(tNear, _mm_load_ps(distance))
+            );
+            return _mm_movemask_ps(mask) != 0;
+#else
+            bool any = false;
+            for(std::size_t lane = 0; lane < PacketSize; lane++)
+            {
+                const float t1x = (node.Min.x - originX[lane]) * inverseX[lane], t2x = (node.Max.x - originX[lane]) * inverseX[lane];
+                const float t1y = (node.Min.y - originY[lane]) * inverseY[lane], t2y = (node.Max.y - originY[lane]) * inverseY[lane];
+                const float t1z = (node.Min.z - originZ[lane]) * inverseZ[lane], t2z = (node.Max.z - originZ[lane]) * inverseZ[lane];
+
+                const float tNear = std::max(std::max(std::min(t1x, t2x), std::min(t1y, t2y)), std::min(t1z, t2z));
+                const float tFar = std::min(std::min(std::max(t1x, t2x), std::max(t1y, t2y)), std::max(t1z, t2z));
+                any |= tFar >= tNear && tFar >= 0 && tNear < distance[lane];
+            }
+            return any;
+#endif
+        };
+
+        if(m_Nodes.empty() || !hitsNode(m_Nodes[0]))
+            return;
+
+        uint32_t stack[MaxDepth];
+        std::size_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+        while(true)
+        {
+            const Node& node = m_Nodes[nodeIndex];
+            if(node.IsLeaf())
+            {
+                for(uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+                {
+                    for(std::size_t lane = 0; lane < rays.size(); lane++)
+                    {
+                        float t, u, v;
+                        if(IntersectTriangle(m_Triangles[i], rays[lane].Origin, rays[lane].Direction, t, u, v) && t < distance[lane])
+                        {
+                            distance[lane] = t;
+                            hits[lane].Distance = t;
+                            hits[lane].Barycentric = glm::vec2(u, v);
+                            hits[lane].Triangle = i;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // Child closer along the packet's average direction first
+                uint32_t nearChild = node.LeftFirst, farChild = node.LeftFirst + 1;
+                const Node& left = m_Nodes[nearChild];
+                const Node& right = m_Nodes[farChild];
+                if(glm::dot((right.Min + right.Max) - (left.Min + left.Max), directionSum) < 0)
+                    std::swap(nearChild, farChild);
+
+                const bool hitNear = hitsNode(m_Nodes[nearChild]);
+                const bool hitFar = hitsNode(m_Nodes[farChild]);
+                if(hitNear || hitFar)
+                {
+                    if(hitNear && hitFar)
+                        stack[stackSize++] = farChild;
+                    nodeIndex = hitNear ? nearChild : farChild;
+                    continue;
+                }
+            }
+
+            if(stackSize == 0)
+                break;
+            nodeIndex = stack[--stackSize];
+        }
+
+        for(std::size_t lane = 0; lane < rays.size(); lane++)
+        {
+            if(hits[lane].IsHit())
+                hits[lane].Info = m_TriangleInfo[hits[lane].Triangle];
+        }
+    }
+
+    bool BspBvh::IsOccluded(const glm::vec3& from, const glm::vec3& to) const
+    {
+        // Surface right at the target does not block it
+        const Ray ray = { from, to - from, 1.0f - 1e-4f };
+
+        Hit hit = {};
+        hit.Distance = ray.MaxDistance;
+        return IntersectSingle<true>(ray, hit);
+    }
+
+    void BspBvh::QueryBox(const glm::vec3& min, const glm::vec3& max, std::vector<TriangleInfo>& out) const
+    {
+        out.clear();
+        if(m_Nodes.empty())
+            return;
+
+        const glm::vec3 center = (min + max) * 0.5f;
+        const glm::vec3 half = (max - min) * 0.5f;
+        const auto overlaps = [&](const Node& node)
+        {
+            return node.Min.x <= max.x && node.Max.x >= min.x &&
+                   node.Min.y <= max.y && node.Max.y >= min.y &&
+                   node.Min.z <= max.z && node.Max.z >= min.z;
+        };
+
+        uint32_t stack[MaxDepth * 2];
+        std::size_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0)
+        {
+            const Node& node = m_Nodes[stack[--stackSize]];
+            if(!overlaps(node))
+                continue;
+
+            if(node.IsLeaf())
+            {
+                for(uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+                {
+                    if(TriangleOverlapsBox(m_Triangles[i], center, half))
+                        out.emplace_back(m_TriangleInfo[i]);
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.LeftFirst + 1;
+                stack[stackSize++] = node.LeftFirst;
+            }
+        }
+
+        SortUniqueFaces(out);
+    }
+    void BspBvh::QueryRadius(const glm::vec3& center, float radius, std::vector<TriangleInfo>& out) const
+    {
+        out.clear();
+        if(m_Nodes.empty())
+            return;
+
+        const float radius2 = radius * radius;
+        const auto overlaps = [&](const Node& node)
+        {
+            const glm::vec3 d = glm::max(glm::max(node.Min - center, center - node.Max), glm::vec3(0));
+            return glm::dot(d, d) <= radius2;
+        };
+
+        uint32_t stack[MaxDepth * 2];
+        std::size_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while(stackSize > 0)
+        {
+            const Node& node = m_Nodes[stack[--stackSize]];
+            if(!overlaps(node))
+                continue;
+
+            if(node.IsLeaf())
+            {
+                for(uint32_t i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+                {
+                    const Triangle& triangle = m_Triangles[i];
+                    const glm::vec3 closest = ClosestPointOnTriangle(center, triangle.V0, triangle.V0 + triangle.Edge1, triangle.V0 + triangle.Edge2);
+                    const glm::vec3 d = closest - center;
+                    if(glm::dot(d, d) <= radius2)
+                        out.emplace_back(m_TriangleInfo[i]);
+                }
+            }
+            else
+            {
+                stack[stackSize++] = node.LeftFirst + 1;
+                stack[stackSize++] = node.LeftFirst;
+            }
+        }
+
+        SortUniqueFaces(out);
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspTree.hpp"
+
+namespace Decay::Bsp::v30
+{
+    /// Bounding Volume Hierarchy over triangles of `BspTree`.
+    /// Built by binned SAH (subtrees in parallel), triangles are copied so the tree does not need to outlive it.
+    /// All queries are read-only and can run from many threads at once.
+    class BspBvh
+    {
+    public:
+        /// `threadCount` = 0 uses number of CPU threads
+        explicit BspBvh(const BspTree& tree, std::size_t threadCount = 0);
+
+    public:
+        static const std::size_t BinCount = 16;
+        /// Nodes with at most this many triangles are not split
+        static const std::size_t MinLeafSize = 2;
+        /// Nodes with more triangles are split even when SAH says it is not worth it
+        static const std::size_t MaxLeafSize = 8;
+        /// Traversal stack size, build stops splitting at this depth
+        static const std::size_t MaxDepth = 64;
+        /// Node boxes are enlarged by this, in map units
+        static constexpr float BoxEpsilon = 1.0f / 128.0f;
+
+        static constexpr uint32_t NoHit = std::numeric_limits<uint32_t>::max();
+
+        struct Node
+        {
+            glm::vec3 Min;
+            /// Leaf = first triangle, otherwise index of first child (second is right after it)
+            uint32_t LeftFirst;
+            glm::vec3 Max;
+            /// Leaf = number of triangles, 0 for inner nodes
+            uint32_t Count;
+
+            [[nodiscard]] inline bool IsLeaf() const noexcept { return Count != 0; }
+        };
+        static_assert(sizeof(Node) == 32, "Two nodes should fit into one cache line");
+
+        /// Prepared for ray intersection
+        struct Triangle
+        {
+            glm::vec3 V0;
+            glm::vec3 Edge1;
+            glm::vec3 Edge2;
+        };
+        struct TriangleInfo
+        {
+            /// Index of `BspFile` face
+            uint32_t Face;
+            /// Index of `BspTree::Textures`
+            uint16_t Texture;
+            /// Index of `BspTree::Models`
+            uint16_t Model;
+
+            [[nodiscard]] inline bool operator==(const TriangleInfo& other) const noexcept
+            {
+                return Face == other.Face && Texture == other.Texture && Model == other.Model;
+            }
+        };
+
+        struct Ray
+        {
+            glm::vec3 Origin;
+            /// Does not need to be normalized, `Hit::Distance` is then in multiples of its length
+            glm::vec3 Direction;
+            float MaxDistance = std::numeric_limits<float>::infinity();
+        };
+        struct Hit
+        {
+            float Distance = std::numeric_limits<float>::infinity();
+            /// Position on the triangle (weights of 2nd and 3rd vertex)
+            glm::vec2 Barycentric = glm::vec2(0);
+            /// Index into `GetTriangles()`
+            uint32_t Triangle = NoHit;
+            TriangleInfo Info = {};
+
+            [[nodiscard]] inline bool IsHit() const noexcept { return Triangle != NoHit; }
+        };
+
+    private:
+        std::vector<Node> m_Nodes;
+        std::vector<Triangle> m_Triangles;
+        std::vector<TriangleInfo> m_TriangleInfo;
+
+    public:
+        [[nodiscard]] inline const std::vector<Node>& GetNodes() const noexcept { return m_Nodes; }
+        [[nodiscard]] inline const std::vector<Triangle>& GetTriangles() const noexcept { return m_Triangles; }
+        [[nodiscard]] inline const std::vector<TriangleInfo>& GetTriangleInfo() const noexcept { return m_TriangleInfo; }
+
+    public:
+        /// Closest hit along the ray
+        [[nodiscard]] Hit Intersect(const Ray& ray) const;
+        /// Closest hits of many rays, traversed in packets of `PacketSize` rays sharing one walk through the tree.
+        /// `hits` must be at least as large as `rays`.
+        void Intersect(std::span<const Ray> rays, std::span<Hit> hits) const;
+        static const std::size_t PacketSize = 4;
+
+        /// Is there any triangle between `from` and `to` (line of sight)
+        [[nodiscard]] bool IsOccluded(const glm::vec3& from, const glm::vec3& to) const;
+
+        /// Every face with a triangle overlapping the box, `out` is cleared first.
+        /// Each face is listed once (sorted by face index).
+        void QueryBox(const glm::vec3& min, const glm::vec3& max, std::vector<TriangleInfo>& out) const;
+        /// Every face with a triangle closer than `radius` to `center`, `out` is cleared first.
+        /// Each face is listed once (sorted by face index).
+        void QueryRadius(const glm::vec3& center, float radius, std::vector<TriangleInfo>& out) const;
+
+    private:
+        template<bool AnyHit>
+        bool IntersectSingle(const Ray& ray, Hit& hit) const;
+        /// At most `PacketSize` rays
+        void IntersectPacket(std::span<const Ray> rays, std::span<Hit> hits) const;
+    };
+}
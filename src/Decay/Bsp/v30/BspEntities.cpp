@@ -63,8 +63,10 @@ namespace Decay::Bsp::v30
         Entities_Model.clear();
 
         // Process entities into fast-access maps
-        for(const Entity& ent : Entities)
+        for(std::size_t i = 0; i < Entities.size(); i++)
         {
+            const Entity& ent = Entities[i];
+
             auto classname = ent.find("classname");
             if(classname != ent.end())
                 Entities_Type[classname->second].emplace_back(ent);
@@ -81,7 +83,7 @@ namespace Decay::Bsp::v30
                     try
                     {
                         int value = std::stoi(model->second.data() + 1);
-                        Entities_Model.emplace(value, ent);
+                        Entities_Model.emplace(value, i);
                     }
                     catch(std::invalid_argument& ex)
                     {
@@ -132,7 +134,7 @@ namespace Decay::Bsp::v30
                 try
                 {
                     int value = std::stoi(model->second.data() + 1);
-                    Entities_Model.emplace(value, entity);
+                    Entities_Model.emplace(value, Entities.size() - 1);
                 }
                 catch(std::invalid_argument& ex)
                 {
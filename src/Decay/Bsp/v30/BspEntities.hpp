@@ -46,7 +46,8 @@ namespace Decay::Bsp::v30
         typedef std::map<std::string, std::string> Entity;
     private:
         std::vector<Entity> Entities{}; //TODO Remove copies in `Entities_*` variables
-        std::map<int, Entity> Entities_Model{};
+        /// [ model ] = index of entity with `"model" "*<model>"`
+        std::map<int, std::size_t> Entities_Model{};
         std::map<std::string, std::vector<Entity>> Entities_Name{};
         std::map<std::string, std::vector<Entity>> Entities_Type{};
     private:
@@ -58,6 +59,14 @@ namespace Decay::Bsp::v30
         [[nodiscard]] inline       Entity& operator[](std::size_t index)       noexcept { return Entities[index]; }
         void emplace(const Entity&);
 
+        static const std::size_t NoEntity = ~static_cast<std::size_t>(0);
+        /// Index of entity using brush model `*<model>`, `NoEntity` when there is none (world)
+        [[nodiscard]] inline std::size_t FindModelEntity(int model) const
+        {
+            auto it = Entities_Model.find(model);
+            return it == Entities_Model.end() ? NoEntity : it->second;
+        }
+
     public:
         [[deprecated("Not fully implemented, use nlohmann::json variant instead")]]
         void ExportJson(const std::filesystem::path& filename) const;
@@ -5,8 +5,19 @@
 // Equivalent to WAD_PALETTE_DUMMY
 //#define BSP_PALETTE_DUMMY 1
 
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+
+#ifndef _WIN32
+#   include <cerrno>
+#   include <climits>
+#   include <fcntl.h>
+#   include <sys/uio.h>
+#   include <unistd.h>
+#endif
 
 #include <stb_image_write.h>
 
@@ -46,244 +57,627 @@ namespace Decay::Bsp::v30
         sizeof(SurfaceEdges),
         sizeof(Model),
     };
-    BspFile::BspFile(const std::filesystem::path& filename)
+    std::array<std::size_t, BspFile::LumpType_Size> BspFile::s_DataElementAlignment = []<std::size_t... I>(std::index_sequence<I...>)
+    {
+        return std::array<std::size_t, LumpType_Size>{ alignof(std::tuple_element_t<I, LumpElementTypes>)... };
+    }(std::make_index_sequence<LumpType_Size>());
+    BspFile::BspFile(const std::filesystem::path& filename, LoadMode mode)
     {
         if(!std::filesystem::exists(filename))
             throw std::runtime_error("File not found");
 
-        std::ifstream in(filename, std::ios_base::binary | std::ios_base::in);
+        if(mode == LoadMode::MemoryMap)
+        {
+            m_Mapping = std::make_unique<MemoryMappedFile>(filename);
+            InitFromBorrowedMemory(m_Mapping->data(), m_Mapping->size());
+            return;
+        }
+
+        std::shared_ptr<std::istream> in = std::make_shared<std::ifstream>(filename, std::ios_base::binary | std::ios_base::in);
+        InitFromReader(CreateStreamReader(in, 0), std::filesystem::file_size(filename), mode);
+    }
+    BspFile::BspFile(std::istream& in, LoadMode mode)
+    {
+        // Everything is relative to current position, BSP may be stored inside another file
+        const std::streamoff start = in.tellg();
+        R_ASSERT(start >= 0, "Input stream does not support seeking");
+
+        in.seekg(0, std::ios_base::end);
+        const std::streamoff end = in.tellg();
+        in.seekg(start);
+        R_ASSERT(end >= start, "Input stream ends before current position");
+
+        // Stream is not owned, caller must keep it alive (`LoadMode::Lazy`)
+        std::shared_ptr<std::istream> inRef(&in, [](std::istream*) {});
+        InitFromReader(CreateStreamReader(std::move(inRef), start), static_cast<std::size_t>(end - start), mode);
+    }
+    BspFile::BspFile(const char* data, std::size_t length)
+    {
+        InitFromMemory(data, length);
+    }
+    BspFile::BspFile(std::span<char> data)
+    {
+        InitFromBorrowedMemory(data.data(), data.size());
+    }
+    BspFile::BspFile(Reader reader, std::size_t length, LoadMode mode)
+    {
+        R_ASSERT(reader != nullptr, "Reader must be provided");
+        InitFromReader(std::move(reader), length, mode);
+    }
+    BspFile::Reader BspFile::CreateStreamReader(std::shared_ptr<std::istream> in, std::streamoff start)
+    {
+        return [in = std::move(in), start](uint32_t offset, uint32_t length, void* out) -> void
+        {
+            in->clear(); // Previous read could reach EOF
+            in->seekg(start + static_cast<std::streamoff>(offset));
+            in->read(static_cast<char*>(out), length);
+            if(in->gcount() != length)
+                throw std::runtime_error("Failed to read from input stream");
+        };
+    }
+    void BspFile::InitFromMemory(const char* data, std::size_t length)
+    {
+        R_ASSERT(data != nullptr, "BSP data must be provided");
+        R_ASSERT(length >= sizeof(Header), "Data are too small to contain BSP header");
+
+        Header header = {};
+        std::copy(
+            data,
+            data + sizeof(Header),
+            reinterpret_cast<char*>(&header)
+        );
+        ProcessHeader(header, length);
+
+        for(std::size_t i = 0; i < LumpType_Size; i++)
+        {
+            const char* lumpData = data + m_DataOffset[i];
+
+            void* d = std::malloc(m_DataLength[i]);
+            std::copy(lumpData, lumpData + m_DataLength[i], static_cast<char*>(d));
+
+            m_Data[i] = d;
+            m_DataOwned[i] = true;
+            m_DataLoaded[i] = true;
+
+            ValidateLump(i);
+        }
+    }
+    void BspFile::InitFromBorrowedMemory(char* data, std::size_t length)
+    {
+        R_ASSERT(data != nullptr, "BSP data must be provided");
+        R_ASSERT(length >= sizeof(Header), "Data are too small to contain BSP header");
+
+        Header header = {};
+        std::copy(
+            data,
+            data + sizeof(Header),
+            reinterpret_cast<char*>(&header)
+        );
+        ProcessHeader(header, length);
 
-        // Magic1 Number
+        for(std::size_t i = 0; i < LumpType_Size; i++)
         {
-            uint32_t magicNumber;
-            in.read(reinterpret_cast<char*>(&magicNumber), sizeof(magicNumber));
+            char* lumpData = data + m_DataOffset[i];
 
-            switch(magicNumber)
+            if(reinterpret_cast<std::uintptr_t>(lumpData) % s_DataElementAlignment[i] == 0)
             {
-                case Magic:
-                    break; // OK
-                case Magic_WrongEndian:
-                    throw std::runtime_error("Invalid endianness");
-                default:
-                    throw std::runtime_error("Unsupported magic number");
+                // No copy, point directly into the memory
+                m_Data[i] = lumpData;
+                m_DataOwned[i] = false;
+            }
+            else
+            {
+                // Typed access would be misaligned, lump gets its own (aligned) memory
+                void* d = std::malloc(m_DataLength[i]);
+                std::copy(lumpData, lumpData + m_DataLength[i], static_cast<char*>(d));
+
+                m_Data[i] = d;
+                m_DataOwned[i] = true;
             }
+            m_DataLoaded[i] = true;
+
+            ValidateLump(i);
         }
+    }
+    void BspFile::InitFromReader(Reader reader, std::size_t length, LoadMode mode)
+    {
+        Header header = {};
+        R_ASSERT(length >= sizeof(Header), "Data are too small to contain BSP header");
+        reader(0, sizeof(Header), &header);
+        ProcessHeader(header, length);
 
-        struct LumpEntry
-        {
-            uint32_t Offset;
-            uint32_t Length;
-        };
+        m_Reader = std::move(reader);
 
-        LumpEntry lumps[LumpType_Size];
-        in.read(reinterpret_cast<char*>(lumps), sizeof(lumps));
+        switch(mode)
+        {
+            case LoadMode::Copy:
+                for(std::size_t i = 0; i < LumpType_Size; i++)
+                    LoadLump(i);
+
+                m_Reader = nullptr; // Close the source
+                break;
+            case LoadMode::Lazy:
+                // Lumps are read by `LoadLump` on first access
+                break;
+            case LoadMode::MemoryMap:
+                throw std::runtime_error("Memory mapping is only supported when loading from a file");
+            default:
+                throw std::runtime_error("Unsupported load mode");
+        }
+    }
+    void BspFile::ProcessHeader(const Header& header, std::size_t fileSize)
+    {
+        switch(header.Magic)
+        {
+            case Magic:
+                break; // OK
+            case Magic_WrongEndian:
+                throw std::runtime_error("Invalid endianness");
+            default:
+                throw std::runtime_error("Unsupported magic number");
+        }
 
         for(std::size_t i = 0; i < LumpType_Size; i++)
         {
-            in.seekg(lumps[i].Offset);
+            R_ASSERT(static_cast<std::size_t>(header.Lumps[i].Offset) + header.Lumps[i].Length <= fileSize, "Lump " << i << " is outside of the file");
 
-            void* d = std::malloc(lumps[i].Length);
-            in.read(reinterpret_cast<char*>(d), lumps[i].Length);
-
-            m_Data[i] = d;
-            m_DataLength[i] = lumps[i].Length;
+            m_DataOffset[i] = header.Lumps[i].Offset;
+            m_DataLength[i] = header.Lumps[i].Length;
         }
+    }
+    void BspFile::LoadLump(std::size_t index) const
+    {
+        std::lock_guard lock(m_ReaderMutex);
+
+        // Another thread could have loaded it while waiting for the lock
+        if(m_DataLoaded[index].load(std::memory_order_relaxed))
+            return;
+
+        R_ASSERT(m_Reader != nullptr, "Lump " << index << " is not loaded and there is no source to load it from");
 
-        in.close();
+        void* d = std::malloc(m_DataLength[index]);
+        m_Data[index] = d;
+        m_DataOwned[index] = true;
 
-        // Tests
+        try
+        {
+            if(m_DataLength[index] != 0)
+                m_Reader(m_DataOffset[index], m_DataLength[index], d);
+
+            ValidateLump(index);
+        }
+        catch(...)
+        {
+            m_Data[index] = nullptr;
+            m_DataOwned[index] = false;
+            std::free(d);
+            throw;
+        }
+
+        m_DataLoaded[index].store(true, std::memory_order_release);
+    }
+    void BspFile::ValidateLump(std::size_t index) const
+    {
+        if(s_DataElementSize[index] != 0)
         {
-            for(std::size_t i = 0; i < LumpType_Size; i++)
-            {
-                if(s_DataElementSize[i] != 0)
-                {
 #ifdef BSP_DEBUG
-                    std::cout << i << ": " << m_DataLength[i] << " < " << (s_DataMaxLength[i] * s_DataElementSize[i]) << " (" << s_DataMaxLength[i] << " * " << s_DataElementSize[i] << ")" << std::endl;
+            std::cout << index << ": " << m_DataLength[index] << " < " << (s_DataMaxLength[index] * s_DataElementSize[index]) << " (" << s_DataMaxLength[index] << " * " << s_DataElementSize[index] << ")" << std::endl;
 #endif
-                    R_ASSERT(m_DataLength[i] < s_DataMaxLength[i] * s_DataElementSize[i], "Lump " << i << " is too short for its content");
-                }
-            }
+            R_ASSERT(m_DataLength[index] < s_DataMaxLength[index] * s_DataElementSize[index], "Lump " << index << " is too short for its content");
+        }
 
-            // Entities
-            {
+        switch(static_cast<LumpType>(index))
+        {
+            case LumpType::Entities:
                 //TODO
-            }
+                break;
 
-            // Planes
-            {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Planes)] % sizeof(Plane) == 0, "Lump size for Planes does not match exactly expected size");
-            }
+            case LumpType::Planes:
+                R_ASSERT(m_DataLength[index] % sizeof(Plane) == 0, "Lump size for Planes does not match exactly expected size");
+                break;
 
-            // Textures
-            {
+            case LumpType::Textures:
                 //TODO
-            }
+                break;
 
-            // Vertices
-            {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Vertices)] % sizeof(glm::vec3) == 0, "Lump size for Vertices does not match exactly expected size");
-            }
+            case LumpType::Vertices:
+                R_ASSERT(m_DataLength[index] % sizeof(glm::vec3) == 0, "Lump size for Vertices does not match exactly expected size");
+                break;
 
-            // Visibility
-            {
+            case LumpType::Visibility:
                 //TODO
-            }
+                break;
 
-            // Nodes
-            {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Nodes)] % sizeof(Node) == 0, "Lump size for Nodes does not match exactly expected size");
-            }
+            case LumpType::Nodes:
+                R_ASSERT(m_DataLength[index] % sizeof(Node) == 0, "Lump size for Nodes does not match exactly expected size");
+                break;
 
-            // Texture Mapping
-            {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::TextureMapping)] % sizeof(TextureMapping) == 0, "Lump size for Texture Mapping does not match exactly expected size");
-            }
+            case LumpType::TextureMapping:
+                R_ASSERT(m_DataLength[index] % sizeof(TextureMapping) == 0, "Lump size for Texture Mapping does not match exactly expected size");
+                break;
+
+            case LumpType::Faces:
+                R_ASSERT(m_DataLength[index] % sizeof(Face) == 0, "Lump size for Faces does not match exactly expected size");
+                break;
+
+            case LumpType::Lighting:
+                //TODO
+                break;
+
+            case LumpType::ClipNodes:
+                R_ASSERT(m_DataLength[index] % sizeof(ClipNode) == 0, "Lump size for Clip Nodes does not match exactly expected size");
+                break;
 
-            // Faces
+            case LumpType::Leaves:
+                R_ASSERT(m_DataLength[index] % sizeof(Leaf) == 0, "Lump size for Leaves does not match exactly expected size");
+                break;
+
+            case LumpType::MarkSurface:
+                R_ASSERT(m_DataLength[index] % sizeof(MarkSurface) == 0, "Lump size for Mark Surface does not match exactly expected size");
+                break;
+
+            case LumpType::Edges:
+                R_ASSERT(m_DataLength[index] % sizeof(Edge) == 0, "Lump size for Edges does not match exactly expected size");
+                break;
+
+            case LumpType::SurfaceEdges:
+                R_ASSERT(m_DataLength[index] % sizeof(SurfaceEdges) == 0, "Lump size for Surface Edges does not match exactly expected size");
+                break;
+
+            case LumpType::Models:
+                R_ASSERT(m_DataLength[index] % sizeof(Model) == 0, "Lump size for Models does not match exactly expected size");
+                R_ASSERT(m_DataLength[index] >= sizeof(Model), "There must be at least 1 model in the BSP file (for static world)");
+                break;
+        }
+    }
+    BspFile::~BspFile()
+    {
+        for(std::size_t i = 0; i < LumpType_Size; i++)
+            FreeLump(i);
+    }
+    void BspFile::Validate() const
+    {
+        if(IsValidated())
+            return;
+        std::lock_guard lock(m_ValidateMutex);
+        if(IsValidated())
+            return;
+
+        const auto planes = GetPlanes();
+        const auto vertices = GetVertices();
+        const auto nodes = GetNodes();
+        const auto textureMapping = GetTextureMapping();
+        const auto faces = GetFaces();
+        const auto clipNodes = GetClipNodes();
+        const auto leaves = GetLeaves();
+        const auto markSurfaces = GetMarkSurfaces();
+        const auto edges = GetEdges();
+        const auto surfaceEdges = GetSurfaceEdges();
+        const auto models = GetModels();
+        const uint32_t textureCount = GetTextureCount();
+        const std::size_t lightingLength = m_DataLength[static_cast<uint8_t>(LumpType::Lighting)];
+        const std::size_t visibilityLength = m_DataLength[static_cast<uint8_t>(LumpType::Visibility)];
+
+        // Every check is a reduction over whole lump (max index / any invalid) without branches inside the loop,
+        // the compiler can vectorize those loops and there is only one comparison per lump.
+
+        // Edges -> Vertices
+        {
+            uint16_t maxVertex = 0;
+            for(const Edge& edge : edges)
+                maxVertex = std::max(maxVertex, std::max(edge.First, edge.Second));
+            R_ASSERT(edges.empty() || maxVertex < vertices.size(), "Edge points to vertex outside of bounds");
+        }
+
+        // Surface Edges -> Edges
+        {
+            int64_t maxEdge = 0;
+            for(const SurfaceEdges& surfaceEdge : surfaceEdges)
+                maxEdge = std::max(maxEdge, std::abs(static_cast<int64_t>(surfaceEdge)));
+            R_ASSERT(surfaceEdges.empty() || maxEdge < static_cast<int64_t>(edges.size()), "Surface Edge points to edge outside of bounds");
+        }
+
+        // Texture Mapping -> Textures
+        {
+            uint32_t maxTexture = 0;
+            for(const TextureMapping& mapping : textureMapping)
+                maxTexture = std::max(maxTexture, mapping.Texture);
+            R_ASSERT(textureMapping.empty() || maxTexture < textureCount, "Texture mapping points to texture outside of bounds");
+        }
+
+        // Faces -> Planes, Texture Mapping, Surface Edges, Lighting
+        {
+            uint16_t maxPlane = 0;
+            uint16_t maxTextureMapping = 0;
+            uint64_t maxSurfaceEdgeEnd = 0;
+            bool invalidEdgeCount = false;
+            int64_t maxLightmapOffset = -1;
+            int32_t minLightmapOffset = -1;
+            for(const Face& face : faces)
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Faces)] % sizeof(Face) == 0, "Lump size for Faces does not match exactly expected size");
+                maxPlane = std::max(maxPlane, face.Plane);
+                maxTextureMapping = std::max(maxTextureMapping, face.TextureMapping);
+                maxSurfaceEdgeEnd = std::max(maxSurfaceEdgeEnd, static_cast<uint64_t>(face.FirstSurfaceEdge) + face.SurfaceEdgeCount);
+                invalidEdgeCount |= (face.SurfaceEdgeCount == 1) | (face.SurfaceEdgeCount == 2);
+                maxLightmapOffset = std::max(maxLightmapOffset, static_cast<int64_t>(face.LightmapOffset));
+                minLightmapOffset = std::min(minLightmapOffset, face.LightmapOffset);
             }
-
-            // Lighting
+            if(!faces.empty())
             {
-                //TODO
+                R_ASSERT(maxPlane < planes.size(), "Face points to plane outside of bounds");
+                R_ASSERT(maxTextureMapping < textureMapping.size(), "Face points to texture mapping outside of bounds");
+                R_ASSERT(maxSurfaceEdgeEnd <= surfaceEdges.size(), "Face points to surface edges outside of bounds");
+                R_ASSERT(!invalidEdgeCount, "Face surface edges do not form a polygon");
+                R_ASSERT(minLightmapOffset >= -1, "Invalid lightmap offset");
+                R_ASSERT(maxLightmapOffset < static_cast<int64_t>(lightingLength) || maxLightmapOffset == -1, "Face points to lightmap outside of bounds");
             }
+        }
 
-            // Clip Nodes
+        // Nodes -> Planes, Nodes, Leaves, Faces
+        {
+            uint32_t maxPlane = 0;
+            int32_t maxNode = 0;
+            int32_t maxLeaf = 0;
+            uint32_t maxFaceEnd = 0;
+            for(const Node& node : nodes)
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::ClipNodes)] % sizeof(ClipNode) == 0, "Lump size for Clip Nodes does not match exactly expected size");
+                maxPlane = std::max(maxPlane, node.PlaneIndex);
+                for(int16_t child : node.ChildrenIndex)
+                {
+                    maxNode = std::max<int32_t>(maxNode, child);
+                    maxLeaf = std::max<int32_t>(maxLeaf, ~static_cast<int32_t>(child));
+                }
+                maxFaceEnd = std::max<uint32_t>(maxFaceEnd, static_cast<uint32_t>(node.FirstFaceIndex) + node.FaceCount);
             }
-
-            // Leaves
+            if(!nodes.empty())
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Leaves)] % sizeof(Leaf) == 0, "Lump size for Leaves does not match exactly expected size");
+                R_ASSERT(maxPlane < planes.size(), "Node points to plane outside of bounds");
+                R_ASSERT(maxNode < static_cast<int32_t>(nodes.size()), "Node points to child node outside of bounds");
+                R_ASSERT(maxLeaf < static_cast<int32_t>(leaves.size()), "Node points to child leaf outside of bounds");
+                R_ASSERT(maxFaceEnd <= faces.size(), "Node points to faces outside of bounds");
             }
+        }
 
-            // Mark Surface
+        // Clip Nodes -> Planes, Clip Nodes
+        {
+            uint32_t maxPlane = 0;
+            int32_t maxClipNode = 0;
+            for(const ClipNode& clipNode : clipNodes)
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::MarkSurface)] % sizeof(MarkSurface) == 0, "Lump size for Mark Surface does not match exactly expected size");
+                maxPlane = std::max(maxPlane, clipNode.PlaneIndex);
+                maxClipNode = std::max<int32_t>(maxClipNode, std::max(clipNode.ChildrenIndex[0], clipNode.ChildrenIndex[1]));
             }
-
-            // Edges
+            if(!clipNodes.empty())
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Edges)] % sizeof(Edge) == 0, "Lump size for Edges does not match exactly expected size");
+                R_ASSERT(maxPlane < planes.size(), "Clip node points to plane outside of bounds");
+                R_ASSERT(maxClipNode < static_cast<int32_t>(clipNodes.size()), "Clip node points to child outside of bounds");
             }
+        }
 
-            // Surface Edges
+        // Leaves -> Mark Surfaces, Visibility
+        {
+            uint32_t maxMarkSurfaceEnd = 0;
+            int32_t maxVisOffset = -1;
+            for(const Leaf& leaf : leaves)
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::SurfaceEdges)] % sizeof(SurfaceEdges) == 0, "Lump size for Surface Edges does not match exactly expected size");
+                maxMarkSurfaceEnd = std::max<uint32_t>(maxMarkSurfaceEnd, static_cast<uint32_t>(leaf.FirstMarkSurface) + leaf.MarkSurfaceCount);
+                maxVisOffset = std::max(maxVisOffset, leaf.VisOffset);
             }
-
-            // Models
+            if(!leaves.empty())
             {
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Models)] % sizeof(Model) == 0, "Lump size for Models does not match exactly expected size");
-                R_ASSERT(m_DataLength[static_cast<uint8_t>(LumpType::Models)] >= sizeof(Model), "There must be at least 1 model in the BSP file (for static world)");
+                R_ASSERT(maxMarkSurfaceEnd <= markSurfaces.size(), "Leaf points to mark surfaces outside of bounds");
+                R_ASSERT(maxVisOffset < static_cast<int64_t>(visibilityLength) || maxVisOffset == -1, "Leaf points to visibility data outside of bounds");
             }
         }
+
+        // Mark Surfaces -> Faces
+        {
+            uint16_t maxFace = 0;
+            for(const MarkSurface& markSurface : markSurfaces)
+                maxFace = std::max(maxFace, static_cast<uint16_t>(markSurface));
+            R_ASSERT(markSurfaces.empty() || maxFace < faces.size(), "Mark surface points to face outside of bounds");
+        }
+
+        // Models -> Faces, Nodes, Clip Nodes
+        for(const Model& model : models)
+        {
+            R_ASSERT(model.FirstFaceIndex >= 0 && model.FaceCount >= 0, "Model has invalid face range");
+            R_ASSERT(static_cast<std::size_t>(model.FirstFaceIndex) + model.FaceCount <= faces.size(), "Model points to faces outside of bounds");
+            R_ASSERT(model.Headnodes[0] < static_cast<int32_t>(nodes.size()), "Model points to node outside of bounds");
+            for(std::size_t hull = 1; hull < MaxHulls; hull++)
+                R_ASSERT(model.Headnodes[hull] < static_cast<int32_t>(clipNodes.size()) || clipNodes.empty(), "Model points to clip node outside of bounds");
+        }
+
+        m_Validated.store(true, std::memory_order_release);
     }
-    BspFile::~BspFile()
+    void BspFile::FreeLump(std::size_t index) noexcept
+    {
+        if(m_DataOwned[index])
+            std::free(m_Data[index]);
+
+        m_Data[index] = nullptr;
+        m_DataLength[index] = 0;
+        m_DataOwned[index] = false;
+        // Lump was emptied, there is nothing to load from the file anymore
+        m_DataLoaded[index].store(true, std::memory_order_release);
+    }
+    void BspFile::Detach()
     {
         for(std::size_t i = 0; i < LumpType_Size; i++)
-            std::free(m_Data[i]);
+        {
+            if(m_DataOwned[i] || m_Data[i] == nullptr)
+                continue;
+
+            void* d = std::malloc(m_DataLength[i]);
+            std::copy(
+                static_cast<const char*>(m_Data[i]),
+                static_cast<const char*>(m_Data[i]) + m_DataLength[i],
+                static_cast<char*>(d)
+            );
+
+            m_Data[i] = d;
+            m_DataOwned[i] = true;
+        }
+
+        m_Mapping.reset();
     }
     uint32_t BspFile::GetTextureCount() const
     {
         MemoryBuffer itemDataBuffer(
-            reinterpret_cast<char*>(m_Data[static_cast<uint8_t>(LumpType::Textures)]),
+            static_cast<char*>(GetLump(LumpType::Textures)),
             m_DataLength[static_cast<uint8_t>(LumpType::Textures)]
         );
         std::istream in(&itemDataBuffer);
 
-        uint32_t count;
+        uint32_t count = 0;
         in.read(reinterpret_cast<char*>(&count), sizeof(count));
 
         return count;
     }
     std::vector<Wad::Wad3::WadFile::Texture> BspFile::GetTextures() const
     {
-        MemoryBuffer itemDataBuffer(
-            reinterpret_cast<char*>(m_Data[static_cast<uint8_t>(LumpType::Textures)]),
-            m_DataLength[static_cast<uint8_t>(LumpType::Textures)]
-        );
-        std::istream in(&itemDataBuffer);
+        std::vector<TextureInfo> infos = GetTextureInfos();
+
+        std::vector<Wad::Wad3::WadFile::Texture> textures(infos.size());
+        for(std::size_t i = 0; i < infos.size(); i++)
+            textures[i] = GetTexture(infos[i]);
+
+        return textures;
+    }
+    std::vector<BspFile::TextureInfo> BspFile::GetTextureInfos() const
+    {
+        const auto* data = static_cast<const uint8_t*>(GetLump(LumpType::Textures));
+        const std::size_t dataLength = m_DataLength[static_cast<uint8_t>(LumpType::Textures)];
+        R_ASSERT(dataLength >= sizeof(uint32_t), "Textures lump is too small");
 
         uint32_t count;
-        in.read(reinterpret_cast<char*>(&count), sizeof(count));
+        std::memcpy(&count, data, sizeof(count));
         R_ASSERT(count < MaxTextures, "Too many textures");
+        R_ASSERT(sizeof(uint32_t) + sizeof(uint32_t) * count <= dataLength, "Texture offsets are outside of Textures Lump");
 
-        std::vector<uint32_t> offsets(count);
-        in.read(reinterpret_cast<char*>(offsets.data()), sizeof(uint32_t) * count);
-
-        std::vector<Wad::Wad3::WadFile::Texture> textures(count);
+        std::vector<TextureInfo> infos(count);
         for(std::size_t i = 0; i < count; i++)
         {
-            R_ASSERT(offsets[i] >= sizeof(uint32_t) + sizeof(uint32_t) * count, "Texture data offset points into offset list - too low value");
-            R_ASSERT(offsets[i] < m_DataLength[static_cast<uint8_t>(LumpType::Textures)], "Texture data offset is outside of Textures Lump");
-            in.seekg(offsets[i]);
+            uint32_t offset;
+            std::memcpy(&offset, data + sizeof(uint32_t) * (1 + i), sizeof(offset));
+            R_ASSERT(offset >= sizeof(uint32_t) + sizeof(uint32_t) * count, "Texture data offset points into offset list - too low value");
+            R_ASSERT(offset + sizeof(Texture) <= dataLength, "Texture data offset is outside of Textures Lump");
 
-            Texture texture = {};
-            in.read(reinterpret_cast<char*>(&texture), sizeof(Texture));
+            Texture texture;
+            std::memcpy(&texture, data + offset, sizeof(Texture));
 
-            Wad::Wad3::WadFile::Texture wadTexture = {
-                texture.Name_str(),
-                texture.Width,
-                texture.Height
-            };
-            R_ASSERT(!wadTexture.Name.empty(), "Texture name cannot be empty");
+            TextureInfo& info = infos[i];
+            info.Name = texture.Name_str();
+            R_ASSERT(!info.Name.empty(), "Texture name cannot be empty");
+            info.Width = texture.Width;
+            info.Height = texture.Height;
+            info.Offset = offset;
 
             if(texture.IsPacked())
             {
-                // MipMap data
                 for(std::size_t level = 0; level < MipTextureLevels; level++)
                 {
-                    wadTexture.MipMapDimensions[level] = {
-                            texture.Width >> level,
-                            texture.Height >> level
-                    };
-                    std::size_t dataLength = static_cast<std::size_t>(wadTexture.MipMapDimensions[level].x) * wadTexture.MipMapDimensions[level].y;
-
-                    std::vector<uint8_t>& data = wadTexture.MipMapData[level];
-                    data.resize(dataLength);
-                    in.read(reinterpret_cast<char*>(data.data()), dataLength);
+                    const glm::u32vec2 size = info.GetMipMapSize(level);
+                    R_ASSERT(
+                        static_cast<std::size_t>(offset) + texture.MipMaps[level] + static_cast<std::size_t>(size.x) * size.y <= dataLength,
+                        "MipMap data are outside of Textures Lump"
+                    );
+                    info.MipMaps[level] = texture.MipMaps[level];
                 }
-                R_ASSERT(texture.Width == wadTexture.MipMapDimensions[0].x, "MipMap level 0 must match texture size (width failed)");
-                R_ASSERT(texture.Height == wadTexture.MipMapDimensions[0].y, "MipMap level 0 must match texture size (height failed)");
 
-                // Palette size after last MipMap level
+                // Palette size and palette follow the last level
+                const std::size_t paletteOffset = GetTextureMipMap(info, MipTextureLevels - 1).size() + offset + info.MipMaps[MipTextureLevels - 1];
+                R_ASSERT(paletteOffset + sizeof(uint16_t) <= dataLength, "Palette is outside of Textures Lump");
+
                 uint16_t paletteSize;
-                in.read(reinterpret_cast<char*>(&paletteSize), sizeof(paletteSize));
+                std::memcpy(&paletteSize, data + paletteOffset, sizeof(paletteSize));
                 if(paletteSize == 0)
                     throw std::runtime_error("Empty Palette");
                 if(paletteSize > 256)
                     throw std::runtime_error("Palette size too big");
+                R_ASSERT(paletteOffset + sizeof(uint16_t) + sizeof(glm::u8vec3) * paletteSize <= dataLength, "Palette is outside of Textures Lump");
+            }
+        }
 
-                // Palette
-                wadTexture.Palette.resize(paletteSize);
-                in.read(reinterpret_cast<char*>(wadTexture.Palette.data()), sizeof(glm::u8vec3) * paletteSize);
+        return infos;
+    }
+    std::span<const uint8_t> BspFile::GetTextureMipMap(const TextureInfo& info, std::size_t level) const
+    {
+        R_ASSERT(level < MipTextureLevels, "Requested mip-map level is too high");
+        R_ASSERT(info.HasData(), "Texture does not contain data");
 
-#ifdef BSP_PALETTE_DUMMY
-                for(std::size_t i = 0, pi = 0; i < 360 && pi < Texture::PaletteSize; i += 360 / Texture::PaletteSize, pi++)
-                {
-                    double hue = i;
-                    double saturation = 90 + std::rand() / (double)RAND_MAX * 10;
-                    double lightness = 50 + std::rand() / (double)RAND_MAX * 10;
-                    glm::dvec3 hsv = {hue, saturation, lightness};
-                    glm::dvec3 rgb = glm::rgbColor(hsv);
+        const glm::u32vec2 size = info.GetMipMapSize(level);
+        return {
+            static_cast<const uint8_t*>(GetLump(LumpType::Textures)) + info.Offset + info.MipMaps[level],
+            static_cast<std::size_t>(size.x) * size.y
+        };
+    }
+    std::span<const glm::u8vec3> BspFile::GetTexturePalette(const TextureInfo& info) const
+    {
+        std::span<const uint8_t> lastLevel = GetTextureMipMap(info, MipTextureLevels - 1);
+        const uint8_t* sizeData = lastLevel.data() + lastLevel.size();
 
-                    texture.Palette[pi] = {rgb.r, rgb.g, rgb.b};
-                }
-#endif
-            }
+        uint16_t paletteSize;
+        std::memcpy(&paletteSize, sizeData, sizeof(paletteSize));
+        return { reinterpret_cast<const glm::u8vec3*>(sizeData + sizeof(paletteSize)), paletteSize };
+    }
+    std::vector<glm::u8vec4> BspFile::GetTextureRgba(const TextureInfo& info, std::size_t level) const
+    {
+        std::span<const uint8_t> indices = GetTextureMipMap(info, level);
+        std::span<const glm::u8vec3> palette = GetTexturePalette(info);
+
+        // Same as `Wad::Wad3::WadFile::Texture::AsRgba`, but without copying the indices first
+        std::array<glm::u8vec4, 256> colors{};
+        for(std::size_t i = 0; i < palette.size(); i++)
+            colors[i] = glm::u8vec4(palette[i], 0xFFu);
+        if(palette.size() == 256 && palette[255] == glm::u8vec3(0x00u, 0x00u, 0xFFu))
+            colors[255] = glm::u8vec4(0x00u, 0x00u, 0xFFu, 0x00u);
+
+        std::vector<glm::u8vec4> pixels(indices.size());
+        for(std::size_t i = 0; i < indices.size(); i++)
+            pixels[i] = colors[indices[i]];
+        return pixels;
+    }
+    Wad::Wad3::WadFile::Texture BspFile::GetTexture(const TextureInfo& info) const
+    {
+        Wad::Wad3::WadFile::Texture texture = {
+            info.Name,
+            info.Width,
+            info.Height
+        };
+        if(!info.HasData())
+            return texture;
+
+        for(std::size_t level = 0; level < MipTextureLevels; level++)
+        {
+            std::span<const uint8_t> data = GetTextureMipMap(info, level);
+            texture.MipMapDimensions[level] = info.GetMipMapSize(level);
+            texture.MipMapData[level].assign(data.begin(), data.end());
+        }
+
+        std::span<const glm::u8vec3> palette = GetTexturePalette(info);
+        texture.Palette.assign(palette.begin(), palette.end());
+
+#ifdef BSP_PALETTE_DUMMY
+        for(std::size_t i = 0, pi = 0; i < 360 && pi < texture.Palette.size(); i += 360 / texture.Palette.size(), pi++)
+        {
+            double hue = i;
+            double saturation = 90 + std::rand() / (double)RAND_MAX * 10;
+            double lightness = 50 + std::rand() / (double)RAND_MAX * 10;
+            glm::dvec3 hsv = {hue, saturation, lightness};
+            glm::dvec3 rgb = glm::rgbColor(hsv);
 
-            textures[i] = std::move(wadTexture);
+            texture.Palette[pi] = {rgb.r, rgb.g, rgb.b};
         }
+#endif
 
-        return textures;
+        return texture;
     }
     void BspFile::SetTextures(const std::vector<Wad::Wad3::WadFile::Texture>& textures)
     {
         // Free old
-        std::free(m_Data[static_cast<uint8_t>(LumpType::Textures)]);
+        FreeLump(static_cast<uint8_t>(LumpType::Textures));
+        m_Validated.store(false, std::memory_order_release); // Texture count could have changed
 
         // No textures
         if(textures.empty())
@@ -291,6 +685,7 @@ namespace Decay::Bsp::v30
             uint32_t* data = reinterpret_cast<uint32_t*>(std::malloc(sizeof(uint32_t)));
             *data = 0; // textures.size()
             m_Data[static_cast<uint8_t>(LumpType::Textures)] = data;
+            m_DataOwned[static_cast<uint8_t>(LumpType::Textures)] = true;
 
             m_DataLength[static_cast<uint8_t>(LumpType::Textures)] = sizeof(uint32_t);
             return;
@@ -311,6 +706,7 @@ namespace Decay::Bsp::v30
         // Allocate memory
         void* data = std::malloc(dataLength);
         m_Data[static_cast<uint8_t>(LumpType::Textures)] = data;
+        m_DataOwned[static_cast<uint8_t>(LumpType::Textures)] = true;
 
         m_DataLength[static_cast<uint8_t>(LumpType::Textures)] = dataLength;
 
@@ -370,50 +766,101 @@ namespace Decay::Bsp::v30
         // `out.flush()` was called at end of Texture Insert Loop
         // `out.close()` should not be needed + destructor will call it after end of this function
     }
-    void BspFile::Save(const std::filesystem::path& filename) const
+    void BspFile::Save(const std::filesystem::path& filename, bool alignLumps) const
     {
-        std::size_t dataSize = 0;
+        // Load everything before the output is opened (it may be the same file)
         for(std::size_t i = 0; i < LumpType_Size; i++)
-            dataSize += m_DataLength[i];
+            (void) GetLump(static_cast<LumpType>(i));
 
-        struct LumpEntry
-        {
-            uint32_t Offset;
-            uint32_t Length;
-        };
+        static const char padding[LumpAlignment] = {};
 
-        LumpEntry lumps[LumpType_Size];
-        std::size_t prevOffset = sizeof(Magic) + sizeof(lumps);
+        Header header = {};
+        header.Magic = Magic;
 
+        // Header + (padding + lump) for every lump, written without copying the lumps
+        std::vector<std::pair<const void*, std::size_t>> segments;
+        segments.reserve(1 + LumpType_Size * 2);
+        segments.emplace_back(&header, sizeof(Header));
+
+        std::size_t prevOffset = sizeof(Header);
         for(std::size_t i = 0; i < LumpType_Size; i++)
         {
-            lumps[i].Length = m_DataLength[i];
-            lumps[i].Offset = prevOffset;
+            if(alignLumps && prevOffset % LumpAlignment != 0)
+            {
+                std::size_t paddingLength = LumpAlignment - prevOffset % LumpAlignment;
+                segments.emplace_back(padding, paddingLength);
+                prevOffset += paddingLength;
+            }
+
+            header.Lumps[i].Length = m_DataLength[i];
+            header.Lumps[i].Offset = prevOffset;
             prevOffset += m_DataLength[i];
+
+            if(m_DataLength[i] != 0)
+                segments.emplace_back(m_Data[i], m_DataLength[i]);
         }
+        R_ASSERT(prevOffset <= std::numeric_limits<uint32_t>::max(), "BSP is too big to be saved");
 
 
-        std::ofstream out(filename.string(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+        // Truncating memory-mapped file would invalidate lumps still pointing into it.
+        // Write into temporary file and replace the original one after that (old mapping keeps the original content).
+        const bool overwritesMapping = m_Mapping && std::filesystem::exists(filename) && std::filesystem::equivalent(filename, m_Mapping->Path);
+        const std::filesystem::path outFilename = overwritesMapping ? std::filesystem::path(filename.string() + ".tmp") : filename;
 
-        // Magic1 number
-        typeof(Magic) magic = Magic;
-        out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+#ifdef _WIN32
+        std::ofstream out(outFilename.string(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+        for(const auto& segment : segments)
+            out.write(static_cast<const char*>(segment.first), segment.second);
+        out.close();
+#else
+        int fd = open(outFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd == -1)
+            throw std::runtime_error("Failed to open file for writing");
 
-        // Lump headers
-        out.write(reinterpret_cast<const char*>(lumps), sizeof(lumps));
+        std::vector<iovec> iov(segments.size());
+        for(std::size_t i = 0; i < segments.size(); i++)
+            iov[i] = { const_cast<void*>(segments[i].first), segments[i].second };
 
-        // Lump data
-        for(std::size_t i = 0; i < LumpType_Size; i++)
-            out.write(reinterpret_cast<const char*>(m_Data[i]), m_DataLength[i]);
+        // Single `writev` is limited by IOV_MAX and may write only part of the data
+        for(std::size_t first = 0; first < iov.size();)
+        {
+            const int count = static_cast<int>(std::min<std::size_t>(iov.size() - first, IOV_MAX));
+            ssize_t written = writev(fd, iov.data() + first, count);
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+                close(fd);
+                throw std::runtime_error("Failed to write BSP file");
+            }
 
-        out.close();
+            // Skip fully written segments, shift partially written one
+            while(first < iov.size() && static_cast<std::size_t>(written) >= iov[first].iov_len)
+            {
+                written -= static_cast<ssize_t>(iov[first].iov_len);
+                first++;
+            }
+            if(written > 0)
+            {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+                iov[first].iov_len -= written;
+            }
+        }
+
+        if(close(fd) != 0)
+            throw std::runtime_error("Failed to finish writing BSP file");
+#endif
+
+        if(overwritesMapping)
+            std::filesystem::rename(outFilename, filename);
     }
     void BspFile::SetEntities(const std::string& entities)
     {
+        FreeLump(static_cast<int>(LumpType::Entities));
+
         auto& data = m_Data[static_cast<int>(LumpType::Entities)];
         auto& dataLength = m_DataLength[static_cast<int>(LumpType::Entities)];
-
-        std::free(data);
+        m_DataOwned[static_cast<int>(LumpType::Entities)] = true;
 
         if(entities.ends_with('\0'))
         {
@@ -431,6 +878,81 @@ namespace Decay::Bsp::v30
             reinterpret_cast<char*>(data)[dataLength - 1] = '\0';
         }
     }
+    bool BspFile::PatchEntities(const std::filesystem::path& filename, const std::string& entities)
+    {
+        if(!std::filesystem::exists(filename))
+            throw std::runtime_error("File not found");
+
+        const std::size_t fileSize = std::filesystem::file_size(filename);
+        std::fstream file(filename, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+
+        Header header = {};
+        file.read(reinterpret_cast<char*>(&header), sizeof(Header));
+        R_ASSERT(file.gcount() == sizeof(Header), "File is too small to contain BSP header");
+        switch(header.Magic)
+        {
+            case Magic:
+                break; // OK
+            case Magic_WrongEndian:
+                throw std::runtime_error("Invalid endianness");
+            default:
+                throw std::runtime_error("Unsupported magic number");
+        }
+
+        LumpEntry& lump = header.Lumps[static_cast<uint8_t>(LumpType::Entities)];
+        R_ASSERT(static_cast<std::size_t>(lump.Offset) + lump.Length <= fileSize, "Entities lump is outside of the file");
+
+        // Same as `SetEntities`, the lump is null-terminated
+        const std::size_t dataLength = entities.ends_with('\0') ? entities.length() : entities.length() + 1;
+        R_ASSERT(dataLength <= std::numeric_limits<uint32_t>::max(), "Entities are too long");
+
+        // Space available for the lump = up to the start of the following lump (including padding between them)
+        std::size_t available = fileSize - lump.Offset;
+        for(std::size_t i = 0; i < LumpType_Size; i++)
+        {
+            if(i == static_cast<uint8_t>(LumpType::Entities) || header.Lumps[i].Length == 0)
+                continue;
+            if(header.Lumps[i].Offset >= lump.Offset)
+                available = std::min<std::size_t>(available, header.Lumps[i].Offset - lump.Offset);
+        }
+        const bool inPlace = dataLength <= available;
+
+        const std::size_t oldLength = lump.Length;
+        if(!inPlace)
+        {
+            // Append at the end of the file, old lump stays unused
+            lump.Offset = (fileSize + LumpAlignment - 1) / LumpAlignment * LumpAlignment;
+            R_ASSERT(static_cast<std::size_t>(lump.Offset) + dataLength <= std::numeric_limits<uint32_t>::max(), "BSP is too big to append entities");
+        }
+        lump.Length = dataLength;
+
+        file.seekp(inPlace ? lump.Offset : fileSize);
+        if(!inPlace)
+        {
+            static const char padding[LumpAlignment] = {};
+            file.write(padding, lump.Offset - fileSize);
+        }
+        file.write(entities.data(), entities.length());
+        if(dataLength != entities.length())
+            file.put('\0');
+
+        // Clear rest of the old lump
+        if(inPlace && oldLength > dataLength)
+        {
+            std::vector<char> zeros(oldLength - dataLength, '\0');
+            file.write(zeros.data(), zeros.size());
+        }
+
+        // Header
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+        file.close();
+        if(file.fail())
+            throw std::runtime_error("Failed to write entities into BSP file");
+
+        return inPlace;
+    }
     void BspFile::TextureParsed::WriteRgbPng(const std::filesystem::path& filename, std::size_t level) const
     {
         std::vector<glm::u8vec3> pixels = AsRgb();
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <tuple>
 #include <vector>
 #include <map>
 #include <glm/glm.hpp>
 
 #include "Decay/Common.hpp"
+#include "Decay/MemoryMappedFile.hpp"
 #include "Decay/Wad/Wad3/WadFile.hpp"
 
 namespace Decay::Bsp::v30
@@ -17,10 +24,41 @@ namespace Decay::Bsp::v30
         static const uint32_t Magic_WrongEndian = 0x1E000000u;
 
     public:
-        explicit BspFile(const std::filesystem::path& filename);
+        enum class LoadMode : uint8_t
+        {
+            /// Every lump is read into its own memory
+            Copy,
+            /// Whole file is memory-mapped and lumps point directly into the mapping.
+            /// Lump gets its own memory only after it is replaced (`SetTextures`, `SetEntities`...).
+            /// Lumps which are not aligned for their element type are copied.
+            MemoryMap,
+            /// Only the header is read, every lump is read (and validated) on its first access.
+            /// The file is kept open until the `BspFile` is destroyed.
+            Lazy
+        };
+
+        /// Reads `length` bytes from `offset` (relative to start of the BSP) into `out`.
+        /// Must throw when the data cannot be read.
+        typedef std::function<void(uint32_t offset, uint32_t length, void* out)> Reader;
+
+    public:
+        explicit BspFile(const std::filesystem::path& filename, LoadMode mode = LoadMode::Copy);
+        /// BSP starts at current position of `in` (`tellg`), all offsets are relative to it.
+        /// For `LoadMode::Lazy` the stream must outlive the `BspFile`, `LoadMode::MemoryMap` is not supported.
+        explicit BspFile(std::istream& in, LoadMode mode = LoadMode::Copy);
+        /// Whole BSP already in memory (archive, network cache...), every lump is copied.
+        BspFile(const char* data, std::size_t length);
+        /// Whole BSP already in memory, lumps point directly into `data` which must outlive the `BspFile`.
+        /// Non-const accessors write straight into `data`, lumps not aligned for their element type are copied.
+        explicit BspFile(std::span<char> data);
+        /// Custom source of `length` bytes, `LoadMode::MemoryMap` is not supported.
+        BspFile(Reader reader, std::size_t length, LoadMode mode = LoadMode::Lazy);
 
         ~BspFile();
 
+        BspFile(const BspFile&) = delete;
+        BspFile& operator=(const BspFile&) = delete;
+
     public:
         enum class LumpType : uint8_t
         {
@@ -43,13 +81,81 @@ namespace Decay::Bsp::v30
         static const std::size_t LumpType_Size = static_cast<uint8_t>(LumpType::Models) + 1;
 
     public:
-        std::array<void*, LumpType_Size> m_Data{};
+        /// May contain `nullptr` for lumps which were not loaded yet (`LoadMode::Lazy`), use `GetLump` to access it.
+        mutable std::array<void*, LumpType_Size> m_Data{};
         std::array<uint32_t, LumpType_Size> m_DataLength{};
+        /// Offset of the lump inside the source file
+        std::array<uint32_t, LumpType_Size> m_DataOffset{};
+        /// `false` when `m_Data` points into memory not allocated by this class (memory-mapped file, user-provided memory)
+        mutable std::array<bool, LumpType_Size> m_DataOwned{};
         static std::array<std::size_t, LumpType_Size> s_DataMaxLength;
         static std::array<std::size_t, LumpType_Size> s_DataElementSize;
+        /// `alignof` of `LumpElementTypes`, borrowed lumps must start at a multiple of it
+        static std::array<std::size_t, LumpType_Size> s_DataElementAlignment;
+
+    private:
+        /// Only used by `LoadMode::MemoryMap`
+        std::unique_ptr<MemoryMappedFile> m_Mapping{};
+
+        /// Only used by `LoadMode::Lazy`
+        Reader m_Reader{};
+        mutable std::mutex m_ReaderMutex{};
+        mutable std::array<std::atomic<bool>, LumpType_Size> m_DataLoaded{};
+
+    private:
+        struct LumpEntry
+        {
+            uint32_t Offset;
+            uint32_t Length;
+        };
+        struct Header
+        {
+            uint32_t Magic;
+            LumpEntry Lumps[LumpType_Size];
+        };
+        static_assert(sizeof(Header) == 124);
+
+        /// Check magic number and lump bounds, fills `m_DataOffset` and `m_DataLength`.
+        void ProcessHeader(const Header& header, std::size_t fileSize);
+
+        /// Copies every lump out of `data`.
+        void InitFromMemory(const char* data, std::size_t length);
+        /// Lumps point directly into `data`.
+        void InitFromBorrowedMemory(char* data, std::size_t length);
+        void InitFromReader(Reader reader, std::size_t length, LoadMode mode);
+
+        [[nodiscard]] static Reader CreateStreamReader(std::shared_ptr<std::istream> in, std::streamoff start);
+
+        /// Read the lump from `m_Reader`, thread-safe.
+        void LoadLump(std::size_t index) const;
+        /// Validate lump's content, called once the lump is loaded.
+        void ValidateLump(std::size_t index) const;
+
+        /// Free memory of the lump (if owned) and reset it to empty.
+        void FreeLump(std::size_t index) noexcept;
+
+    public:
+        /// Get the lump data, loads it first if it was not loaded yet.
+        [[nodiscard]] inline void* GetLump(LumpType type) const
+        {
+            const auto index = static_cast<uint8_t>(type);
+            if(!m_DataLoaded[index].load(std::memory_order_acquire)) [[unlikely]]
+                LoadLump(index);
+            return m_Data[index];
+        }
+        [[nodiscard]] inline bool IsLumpLoaded(LumpType type) const noexcept { return m_DataLoaded[static_cast<uint8_t>(type)].load(std::memory_order_acquire); }
+
+    public:
+        [[nodiscard]] inline bool IsMemoryMapped() const noexcept { return m_Mapping != nullptr; }
+        /// Copy all lumps which still point into memory-mapped file (or user-provided memory) into own memory and release the mapping.
+        void Detach();
 
     public:
         static const std::size_t MaxHulls = 4;
+        /// Slots of `Face::LightingStyles`, every used slot has its own lightmap
+        static const std::size_t MaxLightStyles = 4;
+        /// Value of unused `Face::LightingStyles` slot
+        static constexpr uint8_t UnusedLightStyle = 255;
 
         static const std::size_t MaxModels = 400;
         static const std::size_t MaxBrushes = 4096;
@@ -252,52 +358,151 @@ namespace Decay::Bsp::v30
             int32_t FirstFaceIndex, FaceCount;
         };
 
-#define LUMP_ENTRY(a_fun_vec, a_fun_count, a_fun_raw, a_type, a_lumpType) \
-        [[deprecated("This implementation converts data into a vector (=allocates new memory), use *_raw() + *_count() instead")]]\
-        [[nodiscard]] inline std::vector<a_type> a_fun_vec() const  \
-        {\
-            std::size_t index = static_cast<std::size_t>(LumpType::a_lumpType);\
-            std::vector<a_type> rtn(m_DataLength[index]);\
-            std::copy(\
-                static_cast<char*>(m_Data[index]),\
-                static_cast<char*>(m_Data[index]) + m_DataLength[index],\
-                static_cast<char*>(static_cast<void*>(rtn.data()))\
-            );\
-            return rtn;\
-        }\
-        [[nodiscard]] inline std::size_t a_fun_count() const noexcept\
-        {\
-            return m_DataLength[static_cast<uint8_t>(LumpType::a_lumpType)] / sizeof(a_type);\
-        }\
-        [[nodiscard]] inline const a_type* a_fun_raw() const noexcept\
-        {\
-            return static_cast<const a_type*>(m_Data[static_cast<uint8_t>(LumpType::a_lumpType)]);\
-        }\
-        [[nodiscard]] inline a_type* a_fun_raw() noexcept\
-        {\
-            return static_cast<a_type*>(m_Data[static_cast<uint8_t>(LumpType::a_lumpType)]);\
+        /// Element type stored in each lump, indexed by `LumpType`.
+        /// Lumps without fixed-size elements (Textures, Visibility) are accessed as bytes.
+        typedef std::tuple<
+            char,           // Entities
+            Plane,          // Planes
+            uint8_t,        // Textures
+            glm::vec3,      // Vertices
+            uint8_t,        // Visibility
+            Node,           // Nodes
+            TextureMapping, // TextureMapping
+            Face,           // Faces
+            glm::u8vec3,    // Lighting
+            ClipNode,       // ClipNodes
+            Leaf,           // Leaves
+            MarkSurface,    // MarkSurface
+            Edge,           // Edges
+            SurfaceEdges,   // SurfaceEdges
+            Model           // Models
+        > LumpElementTypes;
+        static_assert(std::tuple_size_v<LumpElementTypes> == LumpType_Size);
+
+        template<LumpType TLump>
+        using LumpElement = std::tuple_element_t<static_cast<std::size_t>(TLump), LumpElementTypes>;
+
+        /// Number of elements inside the lump, does not need the lump to be loaded.
+        template<LumpType TLump>
+        [[nodiscard]] inline std::size_t GetLumpCount() const noexcept
+        {
+            return m_DataLength[static_cast<uint8_t>(TLump)] / sizeof(LumpElement<TLump>);
+        }
+        /// Typed view of the lump (no copy), loads the lump if it was not loaded yet.
+        template<LumpType TLump>
+        [[nodiscard]] inline std::span<const LumpElement<TLump>> GetLumpSpan() const
+        {
+            return { static_cast<const LumpElement<TLump>*>(GetLump(TLump)), GetLumpCount<TLump>() };
         }
+        template<LumpType TLump>
+        [[nodiscard]] inline std::span<LumpElement<TLump>> GetLumpSpan()
+        {
+            return { static_cast<LumpElement<TLump>*>(GetLump(TLump)), GetLumpCount<TLump>() };
+        }
+
+        [[nodiscard]] inline std::span<const char> GetEntityChars() const { return GetLumpSpan<LumpType::Entities>(); }
+        [[nodiscard]] inline std::span<      char> GetEntityChars()       { return GetLumpSpan<LumpType::Entities>(); }
+        [[nodiscard]] inline std::size_t GetEntityCharCount() const noexcept { return GetLumpCount<LumpType::Entities>(); }
+        [[nodiscard]] inline const char* GetRawEntityChars() const { return GetLumpSpan<LumpType::Entities>().data(); }
+        [[nodiscard]] inline       char* GetRawEntityChars()       { return GetLumpSpan<LumpType::Entities>().data(); }
+
+        [[nodiscard]] inline std::span<const Plane> GetPlanes() const { return GetLumpSpan<LumpType::Planes>(); }
+        [[nodiscard]] inline std::span<      Plane> GetPlanes()       { return GetLumpSpan<LumpType::Planes>(); }
+        [[nodiscard]] inline std::size_t GetPlaneCount() const noexcept { return GetLumpCount<LumpType::Planes>(); }
+        [[nodiscard]] inline const Plane* GetRawPlanes() const { return GetLumpSpan<LumpType::Planes>().data(); }
+        [[nodiscard]] inline       Plane* GetRawPlanes()       { return GetLumpSpan<LumpType::Planes>().data(); }
 
-        LUMP_ENTRY(GetEntityChars, GetEntityCharCount, GetRawEntityChars, char, Entities);
-        LUMP_ENTRY(GetPlane, GetPlaneCount, GetRawPlanes, Plane, Planes);
         //TODO Textures
-        LUMP_ENTRY(GetVertices, GetVertexCount, GetRawVertices, glm::vec3, Vertices);
-        //TODO Visibility
-        LUMP_ENTRY(GetNodes, GetNodeCount, GetRawNodes, Node, Nodes);
-        LUMP_ENTRY(GetTextureMapping, GetTextureMappingCount, GetRawTextureMapping, TextureMapping, TextureMapping);
-        LUMP_ENTRY(GetFaces, GetFaceCount, GetRawFaces, Face, Faces);
-        LUMP_ENTRY(GetLighting, GetLightingCount, GetRawLighting, glm::u8vec3, Lighting);
-        LUMP_ENTRY(GetClipNodes, GetClipNodeCount, GetRawClipNodes, ClipNode, ClipNodes);
-        LUMP_ENTRY(GetLeaves, GetLeafCount, GetRawLeaves, Leaf, Leaves);
-        LUMP_ENTRY(GetMarkSurfaces, GetMarkSurfaceCount, GetRawMarkSurfaces, MarkSurface, MarkSurface);
-        LUMP_ENTRY(GetEdges, GetEdgeCount, GetRawEdges, Edge, Edges);
+
+        [[nodiscard]] inline std::span<const glm::vec3> GetVertices() const { return GetLumpSpan<LumpType::Vertices>(); }
+        [[nodiscard]] inline std::span<      glm::vec3> GetVertices()       { return GetLumpSpan<LumpType::Vertices>(); }
+        [[nodiscard]] inline std::size_t GetVertexCount() const noexcept { return GetLumpCount<LumpType::Vertices>(); }
+        [[nodiscard]] inline const glm::vec3* GetRawVertices() const { return GetLumpSpan<LumpType::Vertices>().data(); }
+        [[nodiscard]] inline       glm::vec3* GetRawVertices()       { return GetLumpSpan<LumpType::Vertices>().data(); }
+
+        /// RLE compressed PVS rows, see `BspVisibility` for decompressed queries
+        [[nodiscard]] inline std::span<const uint8_t> GetVisibility() const { return GetLumpSpan<LumpType::Visibility>(); }
+        [[nodiscard]] inline std::span<      uint8_t> GetVisibility()       { return GetLumpSpan<LumpType::Visibility>(); }
+        [[nodiscard]] inline std::size_t GetVisibilityCount() const noexcept { return GetLumpCount<LumpType::Visibility>(); }
+        [[nodiscard]] inline const uint8_t* GetRawVisibility() const { return GetLumpSpan<LumpType::Visibility>().data(); }
+        [[nodiscard]] inline       uint8_t* GetRawVisibility()       { return GetLumpSpan<LumpType::Visibility>().data(); }
+
+        [[nodiscard]] inline std::span<const Node> GetNodes() const { return GetLumpSpan<LumpType::Nodes>(); }
+        [[nodiscard]] inline std::span<      Node> GetNodes()       { return GetLumpSpan<LumpType::Nodes>(); }
+        [[nodiscard]] inline std::size_t GetNodeCount() const noexcept { return GetLumpCount<LumpType::Nodes>(); }
+        [[nodiscard]] inline const Node* GetRawNodes() const { return GetLumpSpan<LumpType::Nodes>().data(); }
+        [[nodiscard]] inline       Node* GetRawNodes()       { return GetLumpSpan<LumpType::Nodes>().data(); }
+
+        [[nodiscard]] inline std::span<const TextureMapping> GetTextureMapping() const { return GetLumpSpan<LumpType::TextureMapping>(); }
+        [[nodiscard]] inline std::span<      TextureMapping> GetTextureMapping()       { return GetLumpSpan<LumpType::TextureMapping>(); }
+        [[nodiscard]] inline std::size_t GetTextureMappingCount() const noexcept { return GetLumpCount<LumpType::TextureMapping>(); }
+        [[nodiscard]] inline const TextureMapping* GetRawTextureMapping() const { return GetLumpSpan<LumpType::TextureMapping>().data(); }
+        [[nodiscard]] inline       TextureMapping* GetRawTextureMapping()       { return GetLumpSpan<LumpType::TextureMapping>().data(); }
+
+        [[nodiscard]] inline std::span<const Face> GetFaces() const { return GetLumpSpan<LumpType::Faces>(); }
+        [[nodiscard]] inline std::span<      Face> GetFaces()       { return GetLumpSpan<LumpType::Faces>(); }
+        [[nodiscard]] inline std::size_t GetFaceCount() const noexcept { return GetLumpCount<LumpType::Faces>(); }
+        [[nodiscard]] inline const Face* GetRawFaces() const { return GetLumpSpan<LumpType::Faces>().data(); }
+        [[nodiscard]] inline       Face* GetRawFaces()       { return GetLumpSpan<LumpType::Faces>().data(); }
+
+        [[nodiscard]] inline std::span<const glm::u8vec3> GetLighting() const { return GetLumpSpan<LumpType::Lighting>(); }
+        [[nodiscard]] inline std::span<      glm::u8vec3> GetLighting()       { return GetLumpSpan<LumpType::Lighting>(); }
+        [[nodiscard]] inline std::size_t GetLightingCount() const noexcept { return GetLumpCount<LumpType::Lighting>(); }
+        [[nodiscard]] inline const glm::u8vec3* GetRawLighting() const { return GetLumpSpan<LumpType::Lighting>().data(); }
+        [[nodiscard]] inline       glm::u8vec3* GetRawLighting()       { return GetLumpSpan<LumpType::Lighting>().data(); }
+
+        [[nodiscard]] inline std::span<const ClipNode> GetClipNodes() const { return GetLumpSpan<LumpType::ClipNodes>(); }
+        [[nodiscard]] inline std::span<      ClipNode> GetClipNodes()       { return GetLumpSpan<LumpType::ClipNodes>(); }
+        [[nodiscard]] inline std::size_t GetClipNodeCount() const noexcept { return GetLumpCount<LumpType::ClipNodes>(); }
+        [[nodiscard]] inline const ClipNode* GetRawClipNodes() const { return GetLumpSpan<LumpType::ClipNodes>().data(); }
+        [[nodiscard]] inline       ClipNode* GetRawClipNodes()       { return GetLumpSpan<LumpType::ClipNodes>().data(); }
+
+        [[nodiscard]] inline std::span<const Leaf> GetLeaves() const { return GetLumpSpan<LumpType::Leaves>(); }
+        [[nodiscard]] inline std::span<      Leaf> GetLeaves()       { return GetLumpSpan<LumpType::Leaves>(); }
+        [[nodiscard]] inline std::size_t GetLeafCount() const noexcept { return GetLumpCount<LumpType::Leaves>(); }
+        [[nodiscard]] inline const Leaf* GetRawLeaves() const { return GetLumpSpan<LumpType::Leaves>().data(); }
+        [[nodiscard]] inline       Leaf* GetRawLeaves()       { return GetLumpSpan<LumpType::Leaves>().data(); }
+
+        [[nodiscard]] inline std::span<const MarkSurface> GetMarkSurfaces() const { return GetLumpSpan<LumpType::MarkSurface>(); }
+        [[nodiscard]] inline std::span<      MarkSurface> GetMarkSurfaces()       { return GetLumpSpan<LumpType::MarkSurface>(); }
+        [[nodiscard]] inline std::size_t GetMarkSurfaceCount() const noexcept { return GetLumpCount<LumpType::MarkSurface>(); }
+        [[nodiscard]] inline const MarkSurface* GetRawMarkSurfaces() const { return GetLumpSpan<LumpType::MarkSurface>().data(); }
+        [[nodiscard]] inline       MarkSurface* GetRawMarkSurfaces()       { return GetLumpSpan<LumpType::MarkSurface>().data(); }
+
+        [[nodiscard]] inline std::span<const Edge> GetEdges() const { return GetLumpSpan<LumpType::Edges>(); }
+        [[nodiscard]] inline std::span<      Edge> GetEdges()       { return GetLumpSpan<LumpType::Edges>(); }
+        [[nodiscard]] inline std::size_t GetEdgeCount() const noexcept { return GetLumpCount<LumpType::Edges>(); }
+        [[nodiscard]] inline const Edge* GetRawEdges() const { return GetLumpSpan<LumpType::Edges>().data(); }
+        [[nodiscard]] inline       Edge* GetRawEdges()       { return GetLumpSpan<LumpType::Edges>().data(); }
+
         /// If the value of the surfedge is positive, the first vertex of the edge is used as vertex for rendering the face,
         /// otherwise, the value is multiplied by -1 and the second vertex of the indexed edge is used.
-        LUMP_ENTRY(GetSurfaceEdges, GetSurfaceEdgeCount, GetRawSurfaceEdges, SurfaceEdges, SurfaceEdges);
-        LUMP_ENTRY(GetModels, GetModelCount, GetRawModels, Model, Models);
+        [[nodiscard]] inline std::span<const SurfaceEdges> GetSurfaceEdges() const { return GetLumpSpan<LumpType::SurfaceEdges>(); }
+        [[nodiscard]] inline std::span<      SurfaceEdges> GetSurfaceEdges()       { return GetLumpSpan<LumpType::SurfaceEdges>(); }
+        [[nodiscard]] inline std::size_t GetSurfaceEdgeCount() const noexcept { return GetLumpCount<LumpType::SurfaceEdges>(); }
+        [[nodiscard]] inline const SurfaceEdges* GetRawSurfaceEdges() const { return GetLumpSpan<LumpType::SurfaceEdges>().data(); }
+        [[nodiscard]] inline       SurfaceEdges* GetRawSurfaceEdges()       { return GetLumpSpan<LumpType::SurfaceEdges>().data(); }
+
+        [[nodiscard]] inline std::span<const Model> GetModels() const { return GetLumpSpan<LumpType::Models>(); }
+        [[nodiscard]] inline std::span<      Model> GetModels()       { return GetLumpSpan<LumpType::Models>(); }
+        [[nodiscard]] inline std::size_t GetModelCount() const noexcept { return GetLumpCount<LumpType::Models>(); }
+        [[nodiscard]] inline const Model* GetRawModels() const { return GetLumpSpan<LumpType::Models>().data(); }
+        [[nodiscard]] inline       Model* GetRawModels()       { return GetLumpSpan<LumpType::Models>().data(); }
 
         [[nodiscard]] inline const Model& GetMainModel() const { return GetRawModels()[0]; }
 
+    private:
+        mutable std::atomic<bool> m_Validated = false;
+        mutable std::mutex m_ValidateMutex{};
+
+    public:
+        /// Check all indices between lumps (faces -> surface edges -> edges -> vertices, texture mapping -> textures, nodes -> planes...).
+        /// Loads all lumps it needs. Throws when any index is outside of its lump.
+        /// Done only once, consumers can skip bounds checks when `IsValidated()` returns `true`.
+        /// Replacing a lump (`SetTextures`...) resets the state, writing into lumps through non-const accessors does not.
+        void Validate() const;
+        [[nodiscard]] inline bool IsValidated() const noexcept { return m_Validated.load(std::memory_order_acquire); }
+
     public:
         struct TextureParsed
         {
@@ -361,12 +566,58 @@ namespace Decay::Bsp::v30
         };
 
         [[nodiscard]] uint32_t GetTextureCount() const;
+        /// Decodes all textures including all their mip-map levels, see `GetTextureInfos` for cheaper access
         [[nodiscard]] std::vector<Wad::Wad3::WadFile::Texture> GetTextures() const;
 
+        /// Texture of Textures lump without its pixels, they are read from the lump on demand
+        struct TextureInfo
+        {
+            std::string Name;
+            union
+            {
+                struct
+                {
+                    uint32_t Width, Height;
+                };
+                glm::u32vec2 Size{};
+            };
+            static_assert(sizeof(Size) == sizeof(Width) + sizeof(Height));
+
+            /// Offset of `Texture` in Textures lump
+            uint32_t Offset = 0;
+            /// Offsets of mip-map levels relative to `Offset`, all 0 if the texture is not packed in BSP
+            uint32_t MipMaps[MipTextureLevels]{};
+
+            [[nodiscard]] inline bool HasData() const noexcept { return MipMaps[0] != 0; }
+            [[nodiscard]] inline glm::u32vec2 GetMipMapSize(std::size_t level) const noexcept { return { Width >> level, Height >> level }; }
+        };
+        /// Only headers of textures are read
+        [[nodiscard]] std::vector<TextureInfo> GetTextureInfos() const;
+        /// Palette indices of one mip-map level, points into the lump. Texture must have data.
+        [[nodiscard]] std::span<const uint8_t> GetTextureMipMap(const TextureInfo& info, std::size_t level = 0) const;
+        /// Palette stored after the last mip-map level, points into the lump. Texture must have data.
+        [[nodiscard]] std::span<const glm::u8vec3> GetTexturePalette(const TextureInfo& info) const;
+        /// One mip-map level decoded through the palette, palette index 255 is transparent if its colour is blue (0, 0, 255)
+        [[nodiscard]] std::vector<glm::u8vec4> GetTextureRgba(const TextureInfo& info, std::size_t level = 0) const;
+        /// All mip-map levels and palette copied out of the lump
+        [[nodiscard]] Wad::Wad3::WadFile::Texture GetTexture(const TextureInfo& info) const;
+
         void SetTextures(const std::vector<Wad::Wad3::WadFile::Texture>& textures);
         void SetEntities(const std::string& entitiesString);
 
-        void Save(const std::filesystem::path& filename) const;
+        /// Alignment of lumps used by original map compilers
+        static const std::size_t LumpAlignment = 4;
+
+        /// Header and lumps are written directly from their memory (no intermediate buffer).
+        /// `alignLumps` pads every lump to start at multiple of `LumpAlignment` (like the original compilers),
+        /// disable it only to get the smallest possible file.
+        void Save(const std::filesystem::path& filename, bool alignLumps = true) const;
+
+        /// Replace only the Entities lump of existing BSP file, rest of the file is not touched.
+        /// Entities are overwritten in place if they fit (including padding before the next lump),
+        /// otherwise they are appended at the end of the file and only the header is updated.
+        /// Returns `true` when the lump was overwritten in place.
+        static bool PatchEntities(const std::filesystem::path& filename, const std::string& entities);
 
     };
 }
@@ -0,0 +1,207 @@
+#include "BspHulls.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace Decay::Bsp::v30
+{
+    const std::array<glm::vec3, BspFile::MaxHulls> BspHulls::HullMins = {
+        glm::vec3(0, 0, 0),
+        glm::vec3(-16, -16, -36),
+        glm::vec3(-32, -32, -32),
+        glm::vec3(-16, -16, -18)
+    };
+    const std::array<glm::vec3, BspFile::MaxHulls> BspHulls::HullMaxs = {
+        glm::vec3(0, 0, 0),
+        glm::vec3(16, 16, 36),
+        glm::vec3(32, 32, 32),
+        glm::vec3(16, 16, 18)
+    };
+
+    BspHulls::BspHulls(std::shared_ptr<BspFile> bsp) : Bsp(std::move(bsp))
+    {
+        Bsp->Validate();
+
+        const auto& bspConst = *Bsp;
+        const auto planes = bspConst.GetPlanes();
+        const auto leaves = bspConst.GetLeaves();
+
+        // Hull 0 - leaves are replaced by their content
+        const auto nodes = bspConst.GetNodes();
+        m_Nodes.reserve(nodes.size());
+        for(std::size_t i = 0; i < nodes.size(); i++)
+        {
+            int32_t children[2];
+            for(std::size_t c = 0; c < 2; c++)
+            {
+                const int32_t child = nodes[i].ChildrenIndex[c];
+                children[c] = child >= 0 ? child : static_cast<int32_t>(leaves[~child].Content);
+            }
+
+            m_Nodes.emplace_back(BspNodeTree::CompileNode(planes[nodes[i].PlaneIndex], i, children));
+        }
+
+        // Hulls 1-3 - clip nodes already store content in place of leaves
+        const auto clipNodes = bspConst.GetClipNodes();
+        m_ClipNodes.reserve(clipNodes.size());
+        for(std::size_t i = 0; i < clipNodes.size(); i++)
+        {
+            const int32_t children[2] = { clipNodes[i].ChildrenIndex[0], clipNodes[i].ChildrenIndex[1] };
+            m_ClipNodes.emplace_back(BspNodeTree::CompileNode(planes[clipNodes[i].PlaneIndex], i, children));
+        }
+    }
+
+    std::size_t BspHulls::SelectHull(const glm::vec3& mins, const glm::vec3& maxs)
+    {
+        // `SV_HullForBsp`
+        const glm::vec3 size = maxs - mins;
+        if(size.x <= 8)
+            return 0;
+        if(size.x <= 36)
+            return size.z <= 36 ? 3 : 1;
+        return 2;
+    }
+
+    int32_t BspHulls::GetHeadNode(std::size_t hull, std::size_t model) const
+    {
+        R_ASSERT(hull < BspFile::MaxHulls, "Hull " << hull << " does not exist");
+        R_ASSERT(model < Bsp->GetModelCount(), "Model " << model << " does not exist");
+
+        const int32_t head = std::as_const(*Bsp).GetRawModels()[model].Headnodes[hull];
+        R_ASSERT(head < 0 || static_cast<std::size_t>(head) < GetHullNodes(hull).size(), "Hull " << hull << " of model " << model << " has no nodes");
+        return head;
+    }
+
+    BspFile::LeafContent BspHulls::PointContents(const BspNodeTree::CompiledNode* nodes, int32_t node, const glm::vec3& point)
+    {
+        while(node >= 0)
+        {
+            const BspNodeTree::CompiledNode& n = nodes[node];
+            node = n.Children[n.PlaneDistance(point) < 0 ? 1 : 0];
+        }
+        return static_cast<BspFile::LeafContent>(node);
+    }
+    BspFile::LeafContent BspHulls::PointContents(const glm::vec3& point, std::size_t hull, std::size_t model) const
+    {
+        return PointContents(GetHullNodes(hull).data(), GetHeadNode(hull, model), point);
+    }
+
+    bool BspHulls::RecursiveHullCheck(
+        const BspNodeTree::CompiledNode* nodes, int32_t head, int32_t node,
+        float startFraction, float endFraction,
+        const glm::vec3& start, const glm::vec3& end,
+        TraceResult& result
+    )
+    {
+        // Reached content = the segment is whole inside of it
+        if(node < 0)
+        {
+            const auto content = static_cast<BspFile::LeafContent>(node);
+            if(content != BspFile::LeafContent::Solid)
+            {
+                result.AllSolid = false;
+                if(content == BspFile::LeafContent::Empty)
+                    result.InOpen = true;
+                else
+                    result.InWater = true;
+            }
+            else
+                result.StartSolid = true;
+
+            return true;
+        }
+
+        const BspNodeTree::CompiledNode& n = nodes[node];
+        const float startDistance = n.PlaneDistance(start);
+        const float endDistance = n.PlaneDistance(end);
+
+        // Whole segment on one side
+        if(startDistance >= 0 && endDistance >= 0)
+            return RecursiveHullCheck(nodes, head, n.Children[0], startFraction, endFraction, start, end, result);
+        if(startDistance < 0 && endDistance < 0)
+            return RecursiveHullCheck(nodes, head, n.Children[1], startFraction, endFraction, start, end, result);
+
+        // Cross point is moved a little to the near side
+        float fraction = startDistance < 0
+            ? (startDistance + DistanceEpsilon) / (startDistance - endDistance)
+            : (startDistance - DistanceEpsilon) / (startDistance - endDistance);
+        fraction = std::clamp(fraction, 0.0f, 1.0f);
+
+        float midFraction = startFraction + (endFraction - startFraction) * fraction;
+        glm::vec3 mid = start + fraction * (end - start);
+        const std::size_t side = startDistance < 0 ? 1 : 0;
+
+        // Move up to the node
+        if(!RecursiveHullCheck(nodes, head, n.Children[side], startFraction, midFraction, start, mid, result))
+            return false;
+
+        // Go past the node
+        if(PointContents(nodes, n.Children[side ^ 1], mid) != BspFile::LeafContent::Solid)
+            return RecursiveHullCheck(nodes, head, n.Children[side ^ 1], midFraction, endFraction, mid, end, result);
+
+        // Never got out of the solid space
+        if(result.AllSolid)
+            return false;
+
+        // Other side of the node is solid = the impact point
+        if(side == 0)
+        {
+            result.PlaneNormal = n.Normal;
+            result.PlaneDistance = n.Distance;
+        }
+        else
+        {
+            result.PlaneNormal = -n.Normal;
+            result.PlaneDistance = -n.Distance;
+        }
+
+        // Epsilon can still leave the point in solid space, back up until it is not
+        while(PointContents(nodes, head, mid) == BspFile::LeafContent::Solid)
+        {
+            fraction -= 0.1f;
+            if(fraction < 0)
+            {
+                result.Fraction = midFraction;
+                result.EndPosition = mid;
+                return false;
+            }
+
+            midFraction = startFraction + (endFraction - startFraction) * fraction;
+            mid = start + fraction * (end - start);
+        }
+
+        result.Fraction = midFraction;
+        result.EndPosition = mid;
+        return false;
+    }
+
+    BspHulls::TraceResult BspHulls::Trace(const glm::vec3& start, const glm::vec3& end, std::size_t hull, std::size_t model) const
+    {
+        const int32_t head = GetHeadNode(hull, model);
+
+        TraceResult result = {};
+        result.EndPosition = end;
+
+        RecursiveHullCheck(GetHullNodes(hull).data(), head, head, 0.0f, 1.0f, start, end, result);
+
+        if(result.AllSolid)
+            result.StartSolid = true;
+
+        return result;
+    }
+    void BspHulls::Trace(std::span<const TraceRequest> requests, std::span<TraceResult> out, std::size_t threadCount) const
+    {
+        R_ASSERT(out.size() >= requests.size(), "Output is smaller than the number of requests");
+
+        // Validated before any trace is started
+        for(const TraceRequest& request : requests)
+            (void) GetHeadNode(request.Hull, request.Model);
+
+        // Every thread gets one contiguous range, results are written to separate elements
+        ParallelFor(requests.size(), threadCount, [this, requests, out](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+                out[i] = Trace(requests[i]);
+        });
+    }
+}
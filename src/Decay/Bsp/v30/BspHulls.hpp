@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspNodeTree.hpp"
+
+namespace Decay::Bsp::v30
+{
+    /// Collision traces against hulls of the map (like `SV_RecursiveHullCheck` in the engine).
+    /// Hull 0 is a point (built from `Nodes`), hulls 1-3 are boxes of fixed size (`ClipNodes`).
+    /// All data are compiled in the constructor, traces never allocate and can run from many threads at once.
+    class BspHulls
+    {
+    public:
+        explicit BspHulls(std::shared_ptr<BspFile> bsp);
+
+    public:
+        const std::shared_ptr<BspFile> Bsp;
+
+        /// Box size of every hull, the box is already baked into the hull's planes
+        static const std::array<glm::vec3, BspFile::MaxHulls> HullMins;
+        static const std::array<glm::vec3, BspFile::MaxHulls> HullMaxs;
+        /// Start point is moved this far away from the hit plane
+        static constexpr float DistanceEpsilon = 0.03125f;
+
+        /// Same selection as the engine does for box of given size
+        [[nodiscard]] static std::size_t SelectHull(const glm::vec3& mins, const glm::vec3& maxs);
+
+        struct TraceResult
+        {
+            /// 0 = hit at the start, 1 = no hit
+            float Fraction = 1.0f;
+            glm::vec3 EndPosition = glm::vec3(0);
+            /// Hit plane, facing against the movement
+            glm::vec3 PlaneNormal = glm::vec3(0);
+            float PlaneDistance = 0;
+
+            /// Whole movement was inside solid space
+            bool AllSolid = true;
+            /// Movement started inside solid space
+            bool StartSolid = false;
+            bool InOpen = false;
+            bool InWater = false;
+        };
+
+        struct TraceRequest
+        {
+            glm::vec3 Start;
+            glm::vec3 End;
+            std::size_t Hull = 0;
+            std::size_t Model = 0;
+        };
+
+    private:
+        /// Negative children are `LeafContent`
+        std::vector<BspNodeTree::CompiledNode> m_Nodes;
+        std::vector<BspNodeTree::CompiledNode> m_ClipNodes;
+
+    private:
+        [[nodiscard]] const std::vector<BspNodeTree::CompiledNode>& GetHullNodes(std::size_t hull) const noexcept
+        {
+            return hull == 0 ? m_Nodes : m_ClipNodes;
+        }
+        [[nodiscard]] int32_t GetHeadNode(std::size_t hull, std::size_t model) const;
+
+        [[nodiscard]] static BspFile::LeafContent PointContents(const BspNodeTree::CompiledNode* nodes, int32_t node, const glm::vec3& point);
+        static bool RecursiveHullCheck(
+            const BspNodeTree::CompiledNode* nodes, int32_t head, int32_t node,
+            float startFraction, float endFraction,
+            const glm::vec3& start, const glm::vec3& end,
+            TraceResult& result
+        );
+
+    public:
+        /// Content at the `point` inside of `hull` of `model`, in model's local space.
+        [[nodiscard]] BspFile::LeafContent PointContents(const glm::vec3& point, std::size_t hull = 0, std::size_t model = 0) const;
+
+        /// Move a point (hull 0) or hull-sized box (1-3) from `start` to `end`, in model's local space.
+        [[nodiscard]] TraceResult Trace(const glm::vec3& start, const glm::vec3& end, std::size_t hull = 0, std::size_t model = 0) const;
+        [[nodiscard]] inline TraceResult Trace(const TraceRequest& request) const
+        {
+            return Trace(request.Start, request.End, request.Hull, request.Model);
+        }
+
+        /// Runs all `requests` split between `threadCount` threads (0 = number of CPU threads).
+        /// `out` must be at least as large as `requests`.
+        void Trace(std::span<const TraceRequest> requests, std::span<TraceResult> out, std::size_t threadCount = 0) const;
+    };
+}
@@ -0,0 +1,77 @@
+#include "BspLightStyles.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace Decay::Bsp::v30
+{
+    const std::array<std::string_view, 13> BspLightStyles::BuiltInPatterns = {
+        "m", // 0 - Normal
+        "mmnmmommommnonmmonqnmmo", // 1 - Flicker A
+        "abcdefghijklmnopqrstuvwxyzyxwvutsrqponmlkjihgfedcba", // 2 - Slow, strong pulse
+        "mmmmmaaaaammmmmaaaaaabcdefgabcdefg", // 3 - Candle A
+        "mamamamamama", // 4 - Fast strobe
+        "jklmnopqrstuvwxyzyxwvutsrqponmlkj", // 5 - Gentle pulse
+        "nmonqnmomnmomomno", // 6 - Flicker B
+        "mmmaaaabcdefgmmmmaaaammmaamm", // 7 - Candle B
+        "mmmaaammmaaammmabcdefaaaammmmabcdefmmmaaaa", // 8 - Candle C
+        "aaaaaaaazzzzzzzz", // 9 - Slow strobe
+        "mmamammmmammamamaaamammma", // 10 - Fluorescent flicker
+        "abcdefghijklmnopqrrqponmlkjihgfedcba", // 11 - Slow pulse, noblack
+        "mmnnmmnnnmmnn" // 12 - Underwater light mutation
+    };
+
+    BspLightStyles::BspLightStyles()
+    {
+        for(std::size_t style = 0; style < BuiltInPatterns.size(); style++)
+            SetPattern(style, BuiltInPatterns[style]);
+    }
+    BspLightStyles::BspLightStyles(const BspEntities& entities) : BspLightStyles()
+    {
+        // Same as `CLight::Spawn` in the game
+        static const int StartOff = 1;
+
+        for(std::size_t i = 0; i < entities.size(); i++)
+        {
+            const BspEntities::Entity& entity = entities[i];
+
+            const auto classname = entity.find("classname");
+            if(classname == entity.end() || (classname->second != "light" && classname->second != "light_spot"))
+                continue;
+
+            const auto styleIt = entity.find("style");
+            if(styleIt == entity.end())
+                continue;
+            const int style = std::atoi(styleIt->second.c_str());
+            if(style < FirstCustomStyle || style >= static_cast<int>(StyleCount))
+                continue;
+
+            const auto spawnflags = entity.find("spawnflags");
+            const auto pattern = entity.find("pattern");
+            if(spawnflags != entity.end() && (std::atoi(spawnflags->second.c_str()) & StartOff) != 0)
+                SetPattern(style, "a");
+            else if(pattern != entity.end() && !pattern->second.empty())
+                SetPattern(style, pattern->second);
+            else
+                SetPattern(style, "m");
+        }
+    }
+
+    void BspLightStyles::SetPattern(uint8_t style, std::string_view pattern)
+    {
+        std::vector<uint16_t>& table = m_Tables[style];
+        table.resize(pattern.size());
+        for(std::size_t i = 0; i < pattern.size(); i++)
+            table[i] = static_cast<uint16_t>((std::clamp(pattern[i], 'a', 'z') - 'a') * BrightnessStep);
+    }
+
+    void BspLightStyles::GetBrightness(uint64_t time_ms, std::array<uint16_t, StyleCount>& out) const noexcept
+    {
+        const uint64_t frame = time_ms * FramesPerSecond / 1000;
+        for(std::size_t style = 0; style < StyleCount; style++)
+        {
+            const std::vector<uint16_t>& table = m_Tables[style];
+            out[style] = table.empty() ? NormalBrightness : table[frame % table.size()];
+        }
+    }
+}
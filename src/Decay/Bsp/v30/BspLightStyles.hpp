@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspEntities.hpp"
+
+namespace Decay::Bsp::v30
+{
+    /// Brightness of light styles over time (like `d_lightstylevalue` in the engine).
+    /// Built-in styles 0-12 are always defined, styles from `FirstCustomStyle` come from named lights in entities.
+    /// Patterns are turned into brightness tables once, sampling them is only a lookup.
+    class BspLightStyles
+    {
+    public:
+        /// Built-in styles only
+        BspLightStyles();
+        /// Built-in styles and styles of lights (`style`, `pattern` and "start off" flag)
+        explicit BspLightStyles(const BspEntities& entities);
+
+    public:
+        static const std::size_t StyleCount = 256;
+        /// Compiler gives styles from this one to named (switchable) lights
+        static const uint8_t FirstCustomStyle = 32;
+        /// Pattern advances by this many characters per second
+        static const uint64_t FramesPerSecond = 10;
+
+        /// Brightness of undefined style, lightmap is used as it is
+        static const uint16_t NormalBrightness = 256;
+        /// Brightness of one step of a pattern ('a' = 0, 'm' = 264, 'z' = 550)
+        static const uint16_t BrightnessStep = 22;
+
+        /// Pattern of every built-in style
+        static const std::array<std::string_view, 13> BuiltInPatterns;
+
+    private:
+        /// [ style ] = brightness for every character of the pattern, empty = `NormalBrightness`
+        std::array<std::vector<uint16_t>, StyleCount> m_Tables;
+
+    public:
+        /// Replaces the pattern of a style (e.g. to switch a light on "m" or off "a"), empty pattern = `NormalBrightness`
+        void SetPattern(uint8_t style, std::string_view pattern);
+
+        /// Brightness at given time, 256 = lightmap as it is
+        [[nodiscard]] inline uint16_t GetBrightness(uint8_t style, uint64_t time_ms) const noexcept
+        {
+            const std::vector<uint16_t>& table = m_Tables[style];
+            if(table.empty())
+                return NormalBrightness;
+            return table[(time_ms * FramesPerSecond / 1000) % table.size()];
+        }
+        /// Brightness of every style at given time
+        void GetBrightness(uint64_t time_ms, std::array<uint16_t, StyleCount>& out) const noexcept;
+
+        /// Brightness changes over time
+        [[nodiscard]] inline bool IsAnimated(uint8_t style) const noexcept { return m_Tables[style].size() > 1; }
+    };
+}
@@ -0,0 +1,151 @@
+#include "BspLightmapCompositor.hpp"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+namespace Decay::Bsp::v30
+{
+    BspLightmapCompositor::BspLightmapCompositor(const BspTree& tree, const BspLightStyles& styles)
+      : Tree(tree), Styles(styles)
+    {
+        // Texels outside of blocks keep the filler of the first layer
+        m_Pages.reserve(Tree.Lightmaps.size());
+        for(const BspTree::Lightmap& lightmap : Tree.Lightmaps)
+            m_Pages.emplace_back(lightmap.Layers[0]);
+
+        Styles.GetBrightness(0, m_Brightness);
+        for(std::size_t page = 0; page < Tree.Lightmaps.size(); page++)
+        {
+            const auto& blocks = Tree.Lightmaps[page].Blocks;
+            for(std::size_t block = 0; block < blocks.size(); block++)
+            {
+                CompositeBlock(page, blocks[block]);
+                m_DirtyBlocks.emplace_back(DirtyBlock{ static_cast<uint32_t>(page), static_cast<uint32_t>(block) });
+            }
+        }
+    }
+
+    std::size_t BspLightmapCompositor::Update(uint64_t time_ms)
+    {
+        m_DirtyBlocks.clear();
+
+        std::array<uint16_t, BspLightStyles::StyleCount> brightness;
+        Styles.GetBrightness(time_ms, brightness);
+
+        std::array<bool, BspLightStyles::StyleCount> changed;
+        bool anyChanged = false;
+        for(std::size_t style = 0; style < BspLightStyles::StyleCount; style++)
+        {
+            changed[style] = brightness[style] != m_Brightness[style];
+            anyChanged |= changed[style];
+        }
+        if(!anyChanged)
+            return 0;
+        m_Brightness = brightness;
+
+        for(std::size_t page = 0; page < Tree.Lightmaps.size(); page++)
+        {
+            const auto& blocks = Tree.Lightmaps[page].Blocks;
+            for(std::size_t block = 0; block < blocks.size(); block++)
+            {
+                const BspTree::Lightmap::Block& b = blocks[block];
+
+                bool dirty = false;
+                for(std::size_t layer = 0; layer < BspFile::MaxLightStyles && b.Styles[layer] != BspFile::UnusedLightStyle; layer++)
+                    dirty |= changed[b.Styles[layer]];
+                if(!dirty)
+                    continue;
+
+                CompositeBlock(page, b);
+                m_DirtyBlocks.emplace_back(DirtyBlock{ static_cast<uint32_t>(page), static_cast<uint32_t>(block) });
+            }
+        }
+
+        return m_DirtyBlocks.size();
+    }
+
+    void BspLightmapCompositor::CompositeBlock(std::size_t page, const BspTree::Lightmap::Block& block)
+    {
+        const BspTree::Lightmap& lightmap = Tree.Lightmaps[page];
+
+        // Missing styles point to the first layer with brightness 0 so the kernel does not need to branch
+        std::array<const uint8_t*, BspFile::MaxLightStyles> layers;
+        std::array<uint16_t, BspFile::MaxLightStyles> brightness;
+        for(std::size_t layer = 0; layer < BspFile::MaxLightStyles; layer++)
+        {
+            const bool used = layer < lightmap.Layers.size() && block.Styles[layer] != BspFile::UnusedLightStyle;
+            layers[layer] = reinterpret_cast<const uint8_t*>(lightmap.Layers[used ? layer : 0].data());
+            brightness[layer] = used ? m_Brightness[block.Styles[layer]] : 0;
+        }
+
+        uint8_t* out = reinterpret_cast<uint8_t*>(m_Pages[page].data());
+        for(uint32_t y = block.Position.y; y < block.Position.y + block.Size.y; y++)
+        {
+            const std::size_t offset = (static_cast<std::size_t>(y) * lightmap.Width + block.Position.x) * 3;
+
+            std::array<const uint8_t*, BspFile::MaxLightStyles> rowLayers;
+            for(std::size_t layer = 0; layer < BspFile::MaxLightStyles; layer++)
+                rowLayers[layer] = layers[layer] + offset;
+
+            Composite(rowLayers, brightness, out + offset, block.Size.x * 3);
+        }
+    }
+
+    void BspLightmapCompositor::Composite(
+        const std::array<const uint8_t*, BspFile::MaxLightStyles>& layers,
+        const std::array<uint16_t, BspFile::MaxLightStyles>& brightness,
+        uint8_t* out, std::size_t count
+    ) noexcept
+    {
+        std::size_t i = 0;
+#ifdef __SSE2__
+        // Bytes of two layers are interleaved into 16-bit pairs, `madd` then gives `a * brightnessA + b * brightnessB` in 32 bits
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i brightness01 = _mm_set1_epi32(static_cast<int32_t>(brightness[0] | (static_cast<uint32_t>(brightness[1]) << 16u)));
+        const __m128i brightness23 = _mm_set1_epi32(static_cast<int32_t>(brightness[2] | (static_cast<uint32_t>(brightness[3]) << 16u)));
+        for(; i + 16 <= count; i += 16)
+        {
+            const __m128i l0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layers[0] + i));
+            const __m128i l1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layers[1] + i));
+            const __m128i l2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layers[2] + i));
+            const __m128i l3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layers[3] + i));
+
+            // 8 bytes of every layer at once
+            const auto compositeHalf = [&](__m128i a0, __m128i a1, __m128i a2, __m128i a3)
+            {
+                const __m128i lo = _mm_add_epi32(
+                    _mm_madd_epi16(_mm_unpacklo_epi16(a0, a1), brightness01),
+                    _mm_madd_epi16(_mm_unpacklo_epi16(a2, a3), brightness23)
+                );
+                const __m128i hi = _mm_add_epi32(
+                    _mm_madd_epi16(_mm_unpackhi_epi16(a0, a1), brightness01),
+                    _mm_madd_epi16(_mm_unpackhi_epi16(a2, a3), brightness23)
+                );
+                return _mm_packs_epi32(_mm_srli_epi32(lo, 8), _mm_srli_epi32(hi, 8));
+            };
+
+            const __m128i low = compositeHalf(
+                _mm_unpacklo_epi8(l0, zero), _mm_unpacklo_epi8(l1, zero),
+                _mm_unpacklo_epi8(l2, zero), _mm_unpacklo_epi8(l3, zero)
+            );
+            const __m128i high = compositeHalf(
+                _mm_unpackhi_epi8(l0, zero), _mm_unpackhi_epi8(l1, zero),
+                _mm_unpackhi_epi8(l2, zero), _mm_unpackhi_epi8(l3, zero)
+            );
+
+            // Saturates to 255
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+        }
+#endif
+        for(; i < count; i++)
+        {
+            uint32_t value = 0;
+            for(std::size_t layer = 0; layer < BspFile::MaxLightStyles; layer++)
+                value += static_cast<uint32_t>(layers[layer][i]) * brightness[layer];
+            out[i] = static_cast<uint8_t>(std::min<uint32_t>(value >> 8u, 255));
+        }
+    }
+}
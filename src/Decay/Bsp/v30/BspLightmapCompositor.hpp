@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspLightStyles.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+
+namespace Decay::Bsp::v30
+{
+    /// Final lightmap of `BspTree::Lightmaps` at given time - style layers of every block scaled by their style brightness and summed
+    /// (like `R_BuildLightMap` in the engine).
+    /// Only blocks whose style brightness changed since the last `Update` are composited again.
+    /// `tree` and `styles` must outlive the compositor.
+    class BspLightmapCompositor
+    {
+    public:
+        /// Everything is composited at time 0
+        BspLightmapCompositor(const BspTree& tree, const BspLightStyles& styles);
+
+    public:
+        const BspTree& Tree;
+        const BspLightStyles& Styles;
+
+        struct DirtyBlock
+        {
+            /// Index of `BspTree::Lightmaps` (and `GetPages()`)
+            uint32_t Page;
+            /// Index of `BspTree::Lightmap::Blocks`
+            uint32_t Block;
+        };
+
+    private:
+        /// RGB, same size as pages of `BspTree::Lightmaps`
+        std::vector<std::vector<glm::u8vec3>> m_Pages;
+        std::vector<DirtyBlock> m_DirtyBlocks;
+        std::array<uint16_t, BspLightStyles::StyleCount> m_Brightness;
+
+    public:
+        [[nodiscard]] inline const std::vector<std::vector<glm::u8vec3>>& GetPages() const noexcept { return m_Pages; }
+        /// Blocks changed by the last `Update` (all of them after construction), for partial upload of the pages
+        [[nodiscard]] inline const std::vector<DirtyBlock>& GetDirtyBlocks() const noexcept { return m_DirtyBlocks; }
+
+        /// Composites blocks using a style whose brightness is different than during the last `Update`.
+        /// Returns number of composited blocks.
+        std::size_t Update(uint64_t time_ms);
+
+    public:
+        /// `out[i] = min(255, sum(layers[l][i] * brightness[l]) / 256)` for `count` bytes, missing layers must have brightness 0.
+        /// Works on bytes so RGB channels do not need to be separated.
+        static void Composite(
+            const std::array<const uint8_t*, BspFile::MaxLightStyles>& layers,
+            const std::array<uint16_t, BspFile::MaxLightStyles>& brightness,
+            uint8_t* out, std::size_t count
+        ) noexcept;
+
+    private:
+        void CompositeBlock(std::size_t page, const BspTree::Lightmap::Block& block);
+    };
+}
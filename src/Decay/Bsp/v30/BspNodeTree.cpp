@@ -0,0 +1,94 @@
+#include "BspNodeTree.hpp"
+
+#include <utility>
+
+namespace Decay::Bsp::v30
+{
+    BspNodeTree::BspNodeTree(std::shared_ptr<BspFile> bsp) : Bsp(std::move(bsp))
+    {
+        Bsp->Validate();
+
+        const auto& bspConst = *Bsp;
+        const auto nodes = bspConst.GetNodes();
+        const auto planes = bspConst.GetPlanes();
+
+        m_Nodes.reserve(nodes.size());
+        for(std::size_t i = 0; i < nodes.size(); i++)
+        {
+            const int32_t children[2] = { nodes[i].ChildrenIndex[0], nodes[i].ChildrenIndex[1] };
+            m_Nodes.emplace_back(CompileNode(planes[nodes[i].PlaneIndex], i, children));
+        }
+    }
+    BspNodeTree::CompiledNode BspNodeTree::CompileNode(const BspFile::Plane& plane, std::size_t index, const int32_t children[2])
+    {
+        CompiledNode compiled = {};
+        compiled.Normal = plane.Normal;
+        compiled.Distance = plane.Distance;
+
+        // Axis-aligned planes may also face the negative direction, those go through the dot product
+        const auto type = static_cast<uint32_t>(plane.Type);
+        compiled.Axis = type < AxisNone && plane.Normal[static_cast<int>(type)] == 1.0f ? type : AxisNone;
+
+        for(std::size_t c = 0; c < 2; c++)
+        {
+            // Compilers write children after their parent, anything else could loop forever
+            R_ASSERT(children[c] < 0 || static_cast<std::size_t>(children[c]) > index, "Node " << index << " points back to its ancestor " << children[c]);
+            compiled.Children[c] = children[c];
+        }
+
+        return compiled;
+    }
+
+    int32_t BspNodeTree::GetRootNode(std::size_t model) const
+    {
+        R_ASSERT(model < Bsp->GetModelCount(), "Model " << model << " does not exist");
+        if(m_Nodes.empty())
+            return ~0; // Everything is the solid leaf
+
+        return std::as_const(*Bsp).GetRawModels()[model].Headnodes[0];
+    }
+
+    void BspNodeTree::FindLeaves(std::span<const glm::vec3> points, std::span<uint32_t> out, std::size_t model) const
+    {
+        R_ASSERT(out.size() >= points.size(), "Output is smaller than the number of points");
+
+        const int32_t root = GetRootNode(model);
+
+        // Independent traversals are interleaved, so the CPU can wait for several nodes at once
+        constexpr std::size_t GroupSize = 8;
+        std::size_t i = 0;
+        for(; i + GroupSize <= points.size(); i += GroupSize)
+        {
+            int32_t node[GroupSize];
+            for(int32_t& n : node)
+                n = root;
+
+            bool active = true;
+            while(active)
+            {
+                active = false;
+                for(std::size_t g = 0; g < GroupSize; g++)
+                {
+                    if(node[g] < 0)
+                        continue;
+
+                    const CompiledNode& n = m_Nodes[node[g]];
+                    node[g] = n.Children[n.PlaneDistance(points[i + g]) > 0 ? 0 : 1];
+                    active |= node[g] >= 0;
+                }
+            }
+
+            for(std::size_t g = 0; g < GroupSize; g++)
+                out[i + g] = static_cast<uint32_t>(~node[g]);
+        }
+
+        for(; i < points.size(); i++)
+            out[i] = FindLeafFrom(points[i], root);
+    }
+    std::vector<uint32_t> BspNodeTree::FindLeaves(std::span<const glm::vec3> points, std::size_t model) const
+    {
+        std::vector<uint32_t> leaves(points.size());
+        FindLeaves(points, leaves, model);
+        return leaves;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+
+namespace Decay::Bsp::v30
+{
+    /// Point-in-leaf queries over `Nodes` lump (hull 0).
+    /// Nodes are compiled into one flat array with their planes inlined,
+    /// so the traversal never touches `Planes` lump.
+    class BspNodeTree
+    {
+    public:
+        explicit BspNodeTree(std::shared_ptr<BspFile> bsp);
+
+    public:
+        const std::shared_ptr<BspFile> Bsp;
+
+    public:
+        /// Plane axis for axis-aligned planes, distance is then only `point[Axis] - Distance`
+        static const uint32_t AxisNone = 3;
+
+        struct CompiledNode
+        {
+            glm::vec3 Normal;
+            float Distance;
+            /// If >= 0, then indices into compiled nodes
+            /// otherwise bitwise inverse indices into Leafs
+            int32_t Children[2];
+            /// 0 = X, 1 = Y, 2 = Z, `AxisNone` = any other plane
+            uint32_t Axis;
+            uint32_t Padding;
+
+            [[nodiscard]] inline float PlaneDistance(const glm::vec3& point) const
+            {
+                if(Axis < AxisNone)
+                    return point[static_cast<int>(Axis)] - Distance;
+                return glm::dot(Normal, point) - Distance;
+            }
+        };
+        static_assert(sizeof(CompiledNode) == 32, "Two nodes should fit into one cache line");
+
+        /// Node `index` with its plane inlined, children must point after the node.
+        [[nodiscard]] static CompiledNode CompileNode(const BspFile::Plane& plane, std::size_t index, const int32_t children[2]);
+
+    private:
+        std::vector<CompiledNode> m_Nodes;
+
+    public:
+        [[nodiscard]] inline const std::vector<CompiledNode>& GetNodes() const noexcept { return m_Nodes; }
+
+        /// Index of the leaf containing the `point` inside BSP tree of `model` (0 = whole world).
+        [[nodiscard]] inline uint32_t FindLeaf(const glm::vec3& point, std::size_t model = 0) const
+        {
+            return FindLeafFrom(point, GetRootNode(model));
+        }
+        /// Same as `FindLeaf` for many points at once, `out` must be at least as large as `points`.
+        /// Points are traversed in interleaved groups to hide memory latency of the nodes.
+        void FindLeaves(std::span<const glm::vec3> points, std::span<uint32_t> out, std::size_t model = 0) const;
+        [[nodiscard]] std::vector<uint32_t> FindLeaves(std::span<const glm::vec3> points, std::size_t model = 0) const;
+
+    private:
+        [[nodiscard]] int32_t GetRootNode(std::size_t model) const;
+
+        [[nodiscard]] inline uint32_t FindLeafFrom(const glm::vec3& point, int32_t node) const
+        {
+            while(node >= 0)
+            {
+                const CompiledNode& n = m_Nodes[node];
+                node = n.Children[n.PlaneDistance(point) > 0 ? 0 : 1];
+            }
+            return static_cast<uint32_t>(~node);
+        }
+    };
+}
@@ -1,131 +1,441 @@
 #include "BspTree.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <map>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace Decay::Bsp::v30
 {
-    BspTree::BspTree(std::shared_ptr<BspFile> bsp)
+    namespace
+    {
+        /// Bottom-left skyline allocator - the top edge of everything placed is kept as a list of horizontal segments
+        class SkylinePacker
+        {
+        public:
+            SkylinePacker(uint32_t width, uint32_t height) : m_Width(width), m_Height(height), m_Skyline{ Segment{0, 0, width} }
+            {
+            }
+
+        private:
+            struct Segment
+            {
+                uint32_t X, Y, Width;
+            };
+
+            uint32_t m_Width, m_Height;
+            /// Sorted by `X`, covers whole width
+            std::vector<Segment> m_Skyline;
+
+        public:
+            /// Places the block as low as possible (then as far left as possible), `false` when there is no space
+            [[nodiscard]] bool Insert(glm::uvec2 size, glm::uvec2& out_position)
+            {
+                std::size_t bestSegment = m_Skyline.size();
+                uint32_t bestY = 0;
+                uint32_t bestTop = std::numeric_limits<uint32_t>::max();
+                for(std::size_t i = 0; i < m_Skyline.size(); i++)
+                {
+                    uint32_t y;
+                    if(Fits(i, size, y) && y + size.y < bestTop)
+                    {
+                        bestSegment = i;
+                        bestY = y;
+                        bestTop = y + size.y;
+                    }
+                }
+                if(bestSegment == m_Skyline.size())
+                    return false;
+
+                out_position = { m_Skyline[bestSegment].X, bestY };
+                AddSegment(bestSegment, Segment{ out_position.x, bestTop, size.x });
+                return true;
+            }
+
+        private:
+            /// Block starting at segment `index` rests on the highest segment under it
+            [[nodiscard]] bool Fits(std::size_t index, glm::uvec2 size, uint32_t& out_y) const
+            {
+                if(m_Skyline[index].X + size.x > m_Width)
+                    return false;
+
+                uint32_t y = 0;
+                for(uint32_t remaining = size.x; remaining > 0; index++)
+                {
+                    y = std::max(y, m_Skyline[index].Y);
+                    if(y + size.y > m_Height)
+                        return false;
+                    remaining -= std::min(remaining, m_Skyline[index].Width);
+                }
+
+                out_y = y;
+                return true;
+            }
+
+            void AddSegment(std::size_t index, Segment segment)
+            {
+                m_Skyline.insert(m_Skyline.begin() + index, segment);
+
+                // Remove or shorten segments which are now covered by the new one
+                const uint32_t end = segment.X + segment.Width;
+                while(index + 1 < m_Skyline.size())
+                {
+                    Segment& next = m_Skyline[index + 1];
+                    if(next.X >= end)
+                        break;
+
+                    const uint32_t nextEnd = next.X + next.Width;
+                    if(nextEnd > end)
+                    {
+                        next.X = end;
+                        next.Width = nextEnd - end;
+                        break;
+                    }
+                    m_Skyline.erase(m_Skyline.begin() + (index + 1));
+                }
+
+                // Merge neighbours of the same height
+                for(std::size_t i = 0; i + 1 < m_Skyline.size();)
+                {
+                    if(m_Skyline[i].Y == m_Skyline[i + 1].Y)
+                    {
+                        m_Skyline[i].Width += m_Skyline[i + 1].Width;
+                        m_Skyline.erase(m_Skyline.begin() + (i + 1));
+                    }
+                    else
+                        i++;
+                }
+            }
+        };
+
+        /// Appends text of OBJ into a string, numbers are formatted the same way as by `std::ostream` in "C" locale
+        class ObjWriter
+        {
+        public:
+            explicit ObjWriter(std::string& text) : m_Text(text)
+            {
+            }
+
+        private:
+            std::string& m_Text;
+
+        public:
+            inline void Reserve(std::size_t additional) { m_Text.reserve(m_Text.size() + additional); }
+
+            inline ObjWriter& operator<<(char c)
+            {
+                m_Text.push_back(c);
+                return *this;
+            }
+            inline ObjWriter& operator<<(std::string_view str)
+            {
+                m_Text.append(str);
+                return *this;
+            }
+            inline ObjWriter& operator<<(uint32_t value)
+            {
+                char buffer[16];
+                const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+                m_Text.append(buffer, result.ptr);
+                return *this;
+            }
+            /// `%g` with 6 significant digits, like default `std::ostream` precision
+            inline ObjWriter& operator<<(float value)
+            {
+                char buffer[32];
+                const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6);
+                m_Text.append(buffer, result.ptr);
+                return *this;
+            }
+        };
+
+        /// Three numbers separated by spaces (`origin`, `angles`...), missing numbers are 0
+        glm::vec3 ParseEntityVector(const BspEntities::Entity& entity, const char* key)
+        {
+            glm::vec3 value = {0, 0, 0};
+
+            const auto it = entity.find(key);
+            if(it == entity.end())
+                return value;
+
+            const char* str = it->second.c_str();
+            for(int i = 0; i < 3; i++)
+            {
+                char* end;
+                value[i] = std::strtof(str, &end);
+                if(end == str)
+                    break;
+                str = end;
+            }
+            return value;
+        }
+
+        /// `angles` of the entity, single `angle` is turned into it the same way the engine does (`ED_ParseEdict`).
+        /// Order of the keys is not kept, `angles` wins when the entity has both.
+        glm::vec3 ParseEntityAngles(const BspEntities::Entity& entity)
+        {
+            const auto angle = entity.find("angle");
+            if(angle == entity.end() || entity.contains("angles"))
+                return ParseEntityVector(entity, "angles");
+
+            // Yaw, -1 = up, -2 = down
+            const float yaw = std::strtof(angle->second.c_str(), nullptr);
+            if(yaw >= 0)
+                return {0, yaw, 0};
+            return static_cast<int>(yaw) == -1 ? glm::vec3(-90, 0, 0) : glm::vec3(90, 0, 0);
+        }
+
+        /// Brush entities which do not use `angles` as their rotation and reset it to zero when spawned
+        bool UsesAnglesAsMoveDirection(const BspEntities::Entity& entity)
+        {
+            const auto classname = entity.find("classname");
+            if(classname == entity.end())
+                return false;
+
+            // Every trigger goes through `InitTrigger`
+            if(classname->second.starts_with("trigger_"))
+                return true;
+
+            // Move direction (`SetMovedir`)
+            static const char* const classes[] = { "func_button", "func_conveyor", "func_door", "func_plat", "func_water", "momentary_door" };
+            if(std::find(std::begin(classes), std::end(classes), classname->second) != std::end(classes))
+                return true;
+
+            // `CBreakable::Spawn` keeps only the yaw (`m_angle`, direction of gibs) and zeroes `angles`
+            return classname->second == "func_breakable";
+        }
+    }
+
+    BspTree::BspTree(std::shared_ptr<BspFile> bsp, std::size_t threadCount, float smoothingAngle)
       : Bsp(std::move(bsp)),
-        Textures(Bsp->GetTextures()),
+        Textures(Bsp->GetTextureInfos()),
         Vertices(),
         Models(Bsp->GetModelCount()),
         Entities(Bsp->GetRawEntityChars(), Bsp->GetEntityCharCount())
     {
-#ifndef DEBUG
-        // First texture
-        // Use it as filler
-        if(Light.UsedRanges.empty())
-            std::fill(
-                Light.Data.begin(),
-                Light.Data.end(),
-                Bsp->GetRawLighting()[Bsp->GetLightingCount() / 2]
-            );
-#endif
+        // All indices between lumps are checked once, face processing does not need to check them again
+        Bsp->Validate();
 
-        // Parse models
+        // Every face of every model gets its own slot and range of corners
+        std::vector<const BspFile::Face*> faces;
+        std::vector<PreparedFace> preparedFaces;
+        std::size_t cornerCount = 0;
         for(std::size_t mi = 0; mi < Models.size(); mi++)
         {
             const BspFile::Model& model = Bsp->GetRawModels()[mi];
-            Models[mi] = ProcessModel(model);
+            for(int32_t fi = model.FirstFaceIndex, fii = 0; fii < model.FaceCount; fi++, fii++)
+            {
+                const BspFile::Face& face = *faces.emplace_back(&Bsp->GetRawFaces()[fi]);
+                PreparedFace& prepared = preparedFaces.emplace_back();
+                prepared.Face = fi;
+                prepared.FirstCorner = cornerCount;
+                cornerCount += face.SurfaceEdgeCount;
+            }
         }
+        std::vector<PreparedCorner> preparedCorners(cornerCount);
+
+        // Parallel - faces do not depend on each other
+        ParallelFor(faces.size(), threadCount, [this, &faces, &preparedFaces, &preparedCorners](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+                PrepareFace(*faces[i], preparedFaces[i], preparedCorners.data() + preparedFaces[i].FirstCorner);
+        });
+
+        // Parallel - faces are smoothed only inside of their model
+        if(smoothingAngle > 0)
+        {
+            std::vector<std::size_t> firstFaces(Models.size() + 1, 0);
+            for(std::size_t mi = 0; mi < Models.size(); mi++)
+                firstFaces[mi + 1] = firstFaces[mi] + Bsp->GetRawModels()[mi].FaceCount;
+
+            ParallelFor(Models.size(), threadCount, [&](std::size_t begin, std::size_t end)
+            {
+                for(std::size_t mi = begin; mi < end; mi++)
+                    SmoothNormals(preparedFaces.data() + firstFaces[mi], firstFaces[mi + 1] - firstFaces[mi], preparedCorners.data(), smoothingAngle);
+            });
+        }
+
+        PackLightmaps(preparedFaces, threadCount);
+
+        // Serial - vertex welding depends on everything added before
+        for(std::size_t mi = 0, firstFace = 0; mi < Models.size(); mi++)
+        {
+            const BspFile::Model& model = Bsp->GetRawModels()[mi];
+            Models[mi] = ProcessModel(model, preparedFaces.data() + firstFace, preparedCorners.data());
+            firstFace += model.FaceCount;
+        }
+
+#ifdef BSP_NO_DUPLICATES
+        // Only needed while adding vertices
+        m_VertexLookup = {};
+#endif
+    }
+#ifdef BSP_NO_DUPLICATES
+    std::size_t BspTree::HashVertex(const Vertex& vertex) noexcept
+    {
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+        const glm::vec2& uv = vertex.ST;
+#else
+        const glm::vec2& uv = vertex.UV;
+#endif
+#ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
+        const glm::vec2& lightUv = vertex.LightST;
+#else
+        const glm::vec2& lightUv = vertex.LightUV;
+#endif
+        // `+ 0.0f` turns -0 into +0, those are equal for `operator==` so they must have same hash
+        const float values[14] = {
+            vertex.Position.x + 0.0f, vertex.Position.y + 0.0f, vertex.Position.z + 0.0f,
+            uv.x + 0.0f, uv.y + 0.0f,
+            lightUv.x + 0.0f, lightUv.y + 0.0f,
+            vertex.Normal.x + 0.0f, vertex.Normal.y + 0.0f, vertex.Normal.z + 0.0f,
+            vertex.Tangent.x + 0.0f, vertex.Tangent.y + 0.0f, vertex.Tangent.z + 0.0f, vertex.Tangent.w + 0.0f
+        };
+
+        uint64_t hash = vertex.LightmapPage;
+        for(float value : values)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            hash = (hash ^ bits) * 0x9E3779B97F4A7C15ull;
+            hash ^= hash >> 29;
+        }
+        return static_cast<std::size_t>(hash ^ (hash >> 32));
     }
-    BspTree::Face BspTree::ProcessFace(const BspFile::Face& face)
+    void BspTree::GrowVertexLookup()
+    {
+        const std::size_t vertexCount = Vertices.size() - m_LookupBaseVertex;
+        std::size_t size = std::max<std::size_t>(m_VertexLookup.size(), 1024);
+        while(size < (vertexCount + 1) * 2)
+            size *= 2;
+        if(size == m_VertexLookup.size())
+            size *= 2;
+
+        m_VertexLookup.assign(size, VertexLookupEmpty);
+
+        // Only the first of equal vertices is ever returned, later ones must not replace it
+        const std::size_t mask = size - 1;
+        for(std::size_t i = m_LookupBaseVertex; i < Vertices.size(); i++)
+        {
+            std::size_t slot = HashVertex(Vertices[i]) & mask;
+            while(m_VertexLookup[slot] != VertexLookupEmpty && !(Vertices[m_VertexLookup[slot]] == Vertices[i]))
+                slot = (slot + 1) & mask;
+            if(m_VertexLookup[slot] == VertexLookupEmpty)
+                m_VertexLookup[slot] = static_cast<uint32_t>(i);
+        }
+    }
+#endif
+
+    void BspTree::PrepareFace(const BspFile::Face& face, PreparedFace& out, PreparedCorner* corners) const
     {
         if(face.SurfaceEdgeCount == 0)
-            return {};
+            return;
+
+        // Bounds of all indices were checked by `BspFile::Validate()`
+        D_ASSERT(Bsp->IsValidated(), "BSP must be validated before processing faces");
+        const auto surfaceEdges = Bsp->GetSurfaceEdges();
+        const auto edges = Bsp->GetEdges();
 
         // Texture info
-        R_ASSERT(face.TextureMapping < Bsp->GetTextureMappingCount(), "Texture mapping is outside of bounds");
+        D_ASSERT(face.TextureMapping < Bsp->GetTextureMappingCount(), "Texture mapping is outside of bounds");
         const BspFile::TextureMapping& textureMapping = Bsp->GetRawTextureMapping()[face.TextureMapping];
         auto textureIndex = textureMapping.Texture;
-        R_ASSERT(textureIndex < Textures.size(), "Texture index (from mapping) is outside of bound");
-
-        const Wad::Wad3::WadFile::Texture& texture = Textures[textureIndex];
+        D_ASSERT(textureIndex < Textures.size(), "Texture index (from mapping) is outside of bound");
 
-
-        Face smartFace = Face();
+        const BspFile::TextureInfo& texture = Textures[textureIndex];
 
         // This should be optimized by compiler
-        smartFace.LightingStyles[0] = face.LightingStyles[0];
-        smartFace.LightingStyles[1] = face.LightingStyles[1];
-        smartFace.LightingStyles[2] = face.LightingStyles[2];
-        smartFace.LightingStyles[3] = face.LightingStyles[3];
+        out.LightingStyles[0] = face.LightingStyles[0];
+        out.LightingStyles[1] = face.LightingStyles[1];
+        out.LightingStyles[2] = face.LightingStyles[2];
+        out.LightingStyles[3] = face.LightingStyles[3];
 
-        smartFace.TextureId = textureIndex;
+        out.TextureId = textureIndex;
+        out.CornerCount = face.SurfaceEdgeCount;
 
-        // Reserve space in `Vertices` and `Indices`
+        // Tangent frame - texture S axis flattened into the plane, T axis only gives handedness
+        const BspFile::Plane& plane = Bsp->GetRawPlanes()[face.Plane];
+        out.Normal = face.PlaneSide != 0 ? -plane.Normal : plane.Normal;
         {
-            std::size_t indicesCount = (face.SurfaceEdgeCount - 2) * 3;
-            Vertices.reserve(indicesCount);
-            smartFace.Indices.reserve(indicesCount);
-        }
+            glm::vec3 tangent = textureMapping.S - out.Normal * glm::dot(out.Normal, textureMapping.S);
+            if(glm::dot(tangent, tangent) < 1e-12f) // Texture projected along the plane, any direction in the plane will do
+                tangent = glm::cross(out.Normal, std::abs(out.Normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0));
+            tangent = glm::normalize(tangent);
 
+            const float handedness = glm::dot(glm::cross(out.Normal, tangent), textureMapping.T) < 0 ? -1.0f : 1.0f;
+            out.Tangent = glm::vec4(tangent.x, tangent.y, tangent.z, handedness);
+        }
 
-        // Get vertex indices from: Face -> Surface Edge -> Edge (-> Vertex)
-        R_ASSERT(face.SurfaceEdgeCount >= 3, "Surface edge does not form a polygon"); // To at least for a triangle
-        std::vector<uint16_t> faceIndices(face.SurfaceEdgeCount);
+        // Get vertices from: Face -> Surface Edge -> Edge -> Vertex
+        D_ASSERT(face.SurfaceEdgeCount >= 3, "Surface edge does not form a polygon"); // To at least for a triangle
         for(
             std::size_t sei = face.FirstSurfaceEdge, seii = 0;
             seii < face.SurfaceEdgeCount;
             sei++, seii++
         )
         {
-            R_ASSERT(sei < Bsp->GetSurfaceEdgeCount(), "Surface Edge index is outside of bounds");
-            const BspFile::SurfaceEdges& surfaceEdge = Bsp->GetRawSurfaceEdges()[sei];
+            D_ASSERT(sei < surfaceEdges.size(), "Surface Edge index is outside of bounds");
+            const BspFile::SurfaceEdges& surfaceEdge = surfaceEdges[sei];
 
+            uint16_t vertexIndex;
             if(surfaceEdge >= 0)
             {
-                R_ASSERT(surfaceEdge < Bsp->GetEdgeCount(), "Edge index is outside of bounds");
-                faceIndices[seii] = Bsp->GetRawEdges()[surfaceEdge].First;
+                D_ASSERT(surfaceEdge < edges.size(), "Edge index is outside of bounds");
+                vertexIndex = edges[surfaceEdge].First;
             }
             else
             {
-                R_ASSERT(-surfaceEdge < Bsp->GetEdgeCount(), "Edge index is outside of bounds");
-                faceIndices[seii] = Bsp->GetRawEdges()[-surfaceEdge].Second; // IdTech2 used ~ (swap bits) instead of - (swap sign)
+                D_ASSERT(-surfaceEdge < edges.size(), "Edge index is outside of bounds");
+                vertexIndex = edges[-surfaceEdge].Second; // IdTech2 used ~ (swap bits) instead of - (swap sign)
             }
+
+            const auto& vertex = Bsp->GetRawVertices()[vertexIndex];
+            PreparedCorner& corner = corners[seii];
+            corner.Position = vertex;
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+            corner.TextureCoordinates = glm::vec2(
+                    textureMapping.GetTexelS(vertex),
+                    textureMapping.GetTexelT(vertex)
+            );
+#else
+            corner.TextureCoordinates = glm::vec2(
+                textureMapping.GetTexelU(vertex, texture.Size),
+                textureMapping.GetTexelV(vertex, texture.Size)
+            );
+#endif
+            corner.S = textureMapping.GetTexelS(vertex);
+            corner.T = textureMapping.GetTexelT(vertex);
+            corner.Normal = out.Normal;
         }
 
         // Lightmap calculation
-        glm::vec2 uvStart = {0, 0}, uvEnd = {0, 0}, uvSize = {0, 0};
-        auto& plane = Bsp->GetRawPlanes()[face.Plane];
-        float minS = 0, maxS = 0;
-        float minT = 0, maxT = 0;
-        glm::ivec2 lightmapSize;
-
-        R_ASSERT(face.LightmapOffset >= -1, "Invalid lightmap offset");
+        D_ASSERT(face.LightmapOffset >= -1, "Invalid lightmap offset");
         if(face.LightmapOffset != -1)
         {
             // Get UV bounds
-            {
-                auto& vertex = Bsp->GetRawVertices()[faceIndices[0]];
-
-                float s = textureMapping.GetTexelS(vertex);
-                minS = s;
-                maxS = s;
-
-                float t = textureMapping.GetTexelT(vertex);
-                minT = t;
-                maxT = t;
-            }
+            float minS = corners[0].S, maxS = corners[0].S;
+            float minT = corners[0].T, maxT = corners[0].T;
             for(std::size_t ii = 1; ii < face.SurfaceEdgeCount; ii++)
             {
-                auto& vertex = Bsp->GetRawVertices()[faceIndices[ii]];
-
-                float s = textureMapping.GetTexelS(vertex);
+                const float s = corners[ii].S;
                 if(s < minS)
                     minS = s;
                 if(s > maxS)
                     maxS = s;
 
-                float t = textureMapping.GetTexelT(vertex);
+                const float t = corners[ii].T;
                 if(t < minT)
                     minT = t;
                 if(t > maxT)
                     maxT = t;
             }
 
-            lightmapSize = glm::ivec2(
+            const glm::ivec2 lightmapSize = glm::ivec2(
                 ceilf(maxS / 16.0f) - floorf(minS / 16.0f) + 1,
                 ceilf(maxT / 16.0f) - floorf(minT / 16.0f) + 1
             );
@@ -135,101 +445,185 @@ namespace Decay::Bsp::v30
             R_ASSERT(lightmapSize.x <= 16);
             R_ASSERT(lightmapSize.y <= 16);
              */
+            // Every used style has its own lightmap, one after another (first one is always read)
+            std::size_t lightmapCount = 1;
+            while(lightmapCount < BspFile::MaxLightStyles && face.LightingStyles[lightmapCount] != BspFile::UnusedLightStyle)
+                lightmapCount++;
+
             int lightmapLength = lightmapSize.x * lightmapSize.y;
-            if(face.LightmapOffset + lightmapLength * 3 > Bsp->GetLightingCount() * 3)
+            if(face.LightmapOffset + lightmapLength * 3 * lightmapCount > Bsp->GetLightingCount() * 3)
                 throw std::runtime_error("Indexing outside of Lightmap");
 
-            AddLight(
-                lightmapSize,
-                reinterpret_cast<const glm::u8vec3*>(reinterpret_cast<const uint8_t*>(Bsp->GetRawLighting()) + face.LightmapOffset),
-                uvStart,
-                uvEnd
-            );
-            uvSize = uvEnd - uvStart;
+            out.LightmapCount = lightmapCount;
+            out.Lightmap = reinterpret_cast<const glm::u8vec3*>(reinterpret_cast<const uint8_t*>(Bsp->GetRawLighting()) + face.LightmapOffset);
+            out.LightmapSize = lightmapSize;
+            out.MinS = minS;
+            out.MinT = minT;
         }
+    }
+    void BspTree::SmoothNormals(const PreparedFace* faces, std::size_t faceCount, PreparedCorner* corners, float smoothingAngle)
+    {
+        struct CornerRef
+        {
+            uint16_t TextureId;
+            std::size_t Face;
+            std::size_t Corner;
+            /// Angle of the polygon at the corner
+            float Weight;
+        };
+        std::vector<CornerRef> refs;
+        for(std::size_t fi = 0; fi < faceCount; fi++)
+        {
+            const PreparedFace& face = faces[fi];
+            for(std::size_t ci = 0; ci < face.CornerCount; ci++)
+            {
+                const glm::vec3& position = corners[face.FirstCorner + ci].Position;
+                const glm::vec3 prev = corners[face.FirstCorner + (ci + face.CornerCount - 1) % face.CornerCount].Position - position;
+                const glm::vec3 next = corners[face.FirstCorner + (ci + 1) % face.CornerCount].Position - position;
 
+                const float lengths = glm::length(prev) * glm::length(next);
+                const float weight = lengths > 0 ? std::acos(std::clamp(glm::dot(prev, next) / lengths, -1.0f, 1.0f)) : 0.0f;
+                refs.push_back({ face.TextureId, fi, face.FirstCorner + ci, weight });
+            }
+        }
 
-        // Triangulate the face
+        // Corners of the same smoothing group (texture) at the same position are next to each other
+        std::sort(refs.begin(), refs.end(), [corners](const CornerRef& a, const CornerRef& b)
+        {
+            const glm::vec3& pa = corners[a.Corner].Position;
+            const glm::vec3& pb = corners[b.Corner].Position;
+            return std::tie(a.TextureId, pa.x, pa.y, pa.z, a.Corner) < std::tie(b.TextureId, pb.x, pb.y, pb.z, b.Corner);
+        });
+
+        const float minCos = std::cos(glm::radians(smoothingAngle));
+        for(std::size_t begin = 0, end; begin < refs.size(); begin = end)
+        {
+            const glm::vec3 position = corners[refs[begin].Corner].Position;
+            for(end = begin + 1; end < refs.size() && refs[end].TextureId == refs[begin].TextureId && corners[refs[end].Corner].Position == position; end++)
+                ;
+            if(end - begin == 1)
+                continue;
+
+            // Face normals are read from faces as corner normals of the group are being replaced
+            for(std::size_t i = begin; i < end; i++)
+            {
+                const glm::vec3& normal = faces[refs[i].Face].Normal;
+
+                // Coplanar neighbours only keep the exact face normal, so the vertices still weld with the rest of the face
+                glm::vec3 sum = {0, 0, 0};
+                bool smoothed = false;
+                for(std::size_t j = begin; j < end; j++)
+                {
+                    const glm::vec3& other = faces[refs[j].Face].Normal;
+                    if(glm::dot(normal, other) >= minCos)
+                    {
+                        sum += other * refs[j].Weight;
+                        smoothed |= other != normal;
+                    }
+                }
+
+                if(smoothed && glm::dot(sum, sum) > 1e-12f)
+                    corners[refs[i].Corner].Normal = glm::normalize(sum);
+            }
+        }
+    }
+    BspTree::Face BspTree::ProcessFace(const PreparedFace& face, const PreparedCorner* corners)
+    {
+        if(face.CornerCount == 0)
+            return {};
+        corners += face.FirstCorner;
+
+        Face smartFace = Face();
+        std::copy(std::begin(face.LightingStyles), std::end(face.LightingStyles), smartFace.LightingStyles);
+        smartFace.TextureId = face.TextureId;
+
+        // Reserve space in `Vertices` and `Indices`
+        {
+            std::size_t indicesCount = (face.CornerCount - 2) * 3;
+            Vertices.reserve(indicesCount);
+            smartFace.Indices.reserve(indicesCount);
+        }
+
+        // Lightmap coordinates the same way as the engine - lightmap texel is 16 texture texels starting at `floor(min / 16) * 16`,
+        // texel centres are at 1/2 (placement is already packed)
+        const glm::vec2 lightmapMins = { std::floor(face.MinS / 16.0f) * 16.0f, std::floor(face.MinT / 16.0f) * 16.0f };
+        const glm::vec2 pageSize = glm::vec2(Lightmaps[face.LightmapPage].Width, Lightmaps[face.LightmapPage].Height);
+        const auto lightmapCoordinates = [&](const PreparedCorner& corner)
         {
+            glm::vec2 texel = {0, 0};
+            if(face.LightmapCollapsed) // Whole face uses centre of one texel, so filtering does not mix in the neighbours
+                texel = glm::vec2(face.LightmapPosition) + 0.5f;
+            else if(face.Lightmap != nullptr)
+                texel = glm::vec2(face.LightmapPosition) + (glm::vec2(corner.S, corner.T) - lightmapMins) / 16.0f + 0.5f;
+            else
+                return texel;
+
 #ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
-            lightmapSize = {1, 1};
+            return texel;
+#else
+            return texel / pageSize;
 #endif
+        };
+
+        // Tangent of the face made perpendicular to the (smoothed) normal of the corner
+        const auto cornerTangent = [&face](const PreparedCorner& corner)
+        {
+            if(corner.Normal == face.Normal)
+                return face.Tangent;
+
+            const glm::vec3 tangent = glm::vec3(face.Tangent.x, face.Tangent.y, face.Tangent.z);
+            const glm::vec3 perpendicular = tangent - corner.Normal * glm::dot(corner.Normal, tangent);
+            if(glm::dot(perpendicular, perpendicular) < 1e-12f)
+                return face.Tangent;
+
+            const glm::vec3 result = glm::normalize(perpendicular);
+            return glm::vec4(result.x, result.y, result.z, face.Tangent.w);
+        };
 
+        // Triangulate the face
+        {
             // Main index
-            auto mainVertex = Bsp->GetRawVertices()[faceIndices[0]];
-#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
-            glm::vec2 mainUV = glm::vec2(
-                    textureMapping.GetTexelS(mainVertex),
-                    textureMapping.GetTexelT(mainVertex)
-            );
-#else
-            glm::vec2 mainUV = glm::vec2(
-                textureMapping.GetTexelU(mainVertex, texture.Size),
-                textureMapping.GetTexelV(mainVertex, texture.Size)
-            );
-#endif
-            glm::vec2 mainLightUV = uvStart + glm::vec2(
-                (textureMapping.GetTexelS(mainVertex) - minS) / lightmapSize.s * uvSize.s,
-                (textureMapping.GetTexelT(mainVertex) - minT) / lightmapSize.t * uvSize.t
-            );
-            uint16_t mainIndex = AddVertex(
+            const PreparedCorner& mainCorner = corners[0];
+            const glm::vec2 mainLightUV = lightmapCoordinates(mainCorner);
+            uint32_t mainIndex = AddVertex(
                 Vertex {
-                    mainVertex,
-                    mainUV,
-                    mainLightUV
+                    mainCorner.Position,
+                    mainCorner.TextureCoordinates,
+                    mainLightUV,
+                    face.LightmapPage,
+                    mainCorner.Normal,
+                    cornerTangent(mainCorner)
                 }
             );
 
             // Second index
-            auto secondVertex = Bsp->GetRawVertices()[faceIndices[1]];
-#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
-            glm::vec2 secondUV = glm::vec2(
-                    textureMapping.GetTexelS(secondVertex),
-                    textureMapping.GetTexelT(secondVertex)
-            );
-#else
-            glm::vec2 secondUV = glm::vec2(
-                textureMapping.GetTexelU(secondVertex, texture.Size),
-                textureMapping.GetTexelV(secondVertex, texture.Size)
-            );
-#endif
-            glm::vec2 secondLightUV = glm::vec2(
-                (textureMapping.GetTexelS(secondVertex) - minS) / lightmapSize.s * uvSize.s,
-                (textureMapping.GetTexelT(secondVertex) - minT) / lightmapSize.t * uvSize.t
-            );
-            uint16_t secondIndex = AddVertex(
+            const PreparedCorner& secondCorner = corners[1];
+            const glm::vec2 secondLightUV = lightmapCoordinates(secondCorner);
+            uint32_t secondIndex = AddVertex(
                 Vertex {
-                    secondVertex,
-                    secondUV,
-                    secondLightUV
+                    secondCorner.Position,
+                    secondCorner.TextureCoordinates,
+                    secondLightUV,
+                    face.LightmapPage,
+                    secondCorner.Normal,
+                    cornerTangent(secondCorner)
                 }
             );
 
             // Other indices
-            R_ASSERT(face.SurfaceEdgeCount >= 3, "Surface Edges does not form a polygon");
-            for(std::size_t ii = 2; ii < face.SurfaceEdgeCount; ii++)
+            R_ASSERT(face.CornerCount >= 3, "Surface Edges does not form a polygon");
+            for(std::size_t ii = 2; ii < face.CornerCount; ii++)
             {
-                auto thirdVertex = Bsp->GetRawVertices()[faceIndices[ii]];
-#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
-                glm::vec2 thirdUV = glm::vec2(
-                        textureMapping.GetTexelS(thirdVertex),
-                        textureMapping.GetTexelT(thirdVertex)
-                );
-#else
-                glm::vec2 thirdUV = glm::vec2(
-                    textureMapping.GetTexelU(thirdVertex, texture.Size),
-                    textureMapping.GetTexelV(thirdVertex, texture.Size)
-                );
-#endif
-                glm::vec2 thirdLightUV = glm::vec2(
-                    (textureMapping.GetTexelS(thirdVertex) - minS) / lightmapSize.s * uvSize.s,
-                    (textureMapping.GetTexelT(thirdVertex) - minT) / lightmapSize.t * uvSize.t
-                );
-                uint16_t thirdIndex = AddVertex(
+                const PreparedCorner& thirdCorner = corners[ii];
+                const glm::vec2 thirdLightUV = lightmapCoordinates(thirdCorner);
+                uint32_t thirdIndex = AddVertex(
                     Vertex {
-                        thirdVertex,
-                        thirdUV,
-                        thirdLightUV
+                        thirdCorner.Position,
+                        thirdCorner.TextureCoordinates,
+                        thirdLightUV,
+                        face.LightmapPage,
+                        thirdCorner.Normal,
+                        cornerTangent(thirdCorner)
                     }
                 );
 
@@ -247,115 +641,252 @@ namespace Decay::Bsp::v30
 
         return smartFace;
     }
-    void BspTree::ExportFlatObj(const std::filesystem::path& filename, const std::filesystem::path& mtlFilename) const
+    void BspTree::ExportFlatObj(const std::filesystem::path& filename, const std::filesystem::path& mtlFilename, std::size_t threadCount) const
     {
+        // Every texture range of every model is a separate chunk, polygons never continue between ranges
+        struct Chunk
+        {
+            std::size_t Model;
+            std::size_t Range;
+            std::string Text;
+        };
+        static const std::size_t NoRange = ~static_cast<std::size_t>(0);
+        std::vector<Chunk> chunks;
+        for(std::size_t mi = 0; mi < Models.size(); mi++)
+        {
+            // Model without triangles still writes its name
+            if(Models[mi]->TextureRanges.empty())
+                chunks.push_back({ mi, NoRange, {} });
+            for(std::size_t ri = 0; ri < Models[mi]->TextureRanges.size(); ri++)
+                chunks.push_back({ mi, ri, {} });
+        }
+
+        // Vertices are split into chunks of the same size as ranges would have very different sizes
+        static const std::size_t VerticesPerChunk = 1u << 14u;
+        std::vector<std::string> vertexChunks((Vertices.size() + VerticesPerChunk - 1) / VerticesPerChunk);
+
+        ParallelFor(vertexChunks.size() + chunks.size(), threadCount, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                if(i < vertexChunks.size())
+                {
+                    const std::size_t first = i * VerticesPerChunk;
+                    ExportObjVertices(vertexChunks[i], std::span<const Vertex>(Vertices).subspan(first, std::min(VerticesPerChunk, Vertices.size() - first)));
+                    continue;
+                }
+
+                Chunk& chunk = chunks[i - vertexChunks.size()];
+                const Model& model = *Models[chunk.Model];
+                if(chunk.Range == 0 || chunk.Range == NoRange)
+                    ExportObjModelName(chunk.Text, chunk.Model);
+                if(chunk.Range != NoRange)
+                {
+                    // +1 because OBJ starts at 1 instead of 0
+                    ExportObjFaces(chunk.Text, model, model.TextureRanges[chunk.Range], model.BaseVertex + 1);
+                }
+            }
+        });
+
+        std::ofstream out(filename.string(), std::ios_base::out | std::ios_base::trunc);
+        ExportObjHeader(out, mtlFilename);
+        for(const std::string& text : vertexChunks)
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        for(const Chunk& chunk : chunks)
+            out.write(chunk.Text.data(), static_cast<std::streamsize>(chunk.Text.size()));
+
+        if(!out.good())
+            throw std::runtime_error("Failed to write OBJ file");
+    }
+    void BspTree::ExportModelObj(const ModelMesh& mesh, const std::filesystem::path& filename, const std::filesystem::path& mtlFilename) const
+    {
+        R_ASSERT(mesh.Source != nullptr, "Mesh does not have a model");
+
         std::ofstream out(filename.string(), std::ios_base::out | std::ios_base::trunc);
 
+        ExportObjHeader(out, mtlFilename);
+
+        // Transform is in BSP space (Z up), vertices are converted like in `ExportFlatObj`
+        out << "# Model: *" << mesh.ModelIndex << '\n';
+        if(mesh.EntityIndex != BspEntities::NoEntity)
+        {
+            const BspEntities::Entity& entity = Entities[mesh.EntityIndex];
+            const auto classname = entity.find("classname");
+            const auto targetname = entity.find("targetname");
+
+            out << "# Entity: " << mesh.EntityIndex;
+            if(classname != entity.end())
+                out << ' ' << classname->second;
+            if(targetname != entity.end())
+                out << " \"" << targetname->second << '"';
+            out << '\n';
+        }
+        out << "# Origin: " << mesh.Origin.x << ' ' << mesh.Origin.y << ' ' << mesh.Origin.z << '\n';
+        out << "# Angles: " << mesh.Angles.x << ' ' << mesh.Angles.y << ' ' << mesh.Angles.z << '\n';
+
+        std::string text;
+        ExportObjVertices(text, mesh.Vertices);
+        ExportObjModelName(text, mesh.ModelIndex);
+        for(const auto& range : mesh.Source->TextureRanges)
+            ExportObjFaces(text, *mesh.Source, range, 1);
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+
+        if(!out.good())
+            throw std::runtime_error("Failed to write OBJ file");
+    }
+    void BspTree::ExportObjHeader(std::ostream& out, const std::filesystem::path& mtlFilename)
+    {
         // Header
         {
-            out << "# .obj file generated by Decay Library" << std::endl;
+            out << "# .obj file generated by Decay Library" << '\n';
 
             auto now = std::chrono::system_clock::now();
             std::time_t nowTime = std::chrono::system_clock::to_time_t(now);
-            out << "# Exported: " << std::ctime(&nowTime) << std::endl;
+            out << "# Exported: " << std::ctime(&nowTime) << '\n';
         }
 
         // MTL file
         if(!mtlFilename.empty())
-            out << "mtllib " << mtlFilename << std::endl;
-
-        out.flush();
+            out << "mtllib " << mtlFilename << '\n';
+    }
+    void BspTree::ExportObjVertices(std::string& text, std::span<const Vertex> vertices)
+    {
+        ObjWriter out(text);
+        out.Reserve(vertices.size() * 72);
 
-        // Vertices
-        for(const auto& vec : Vertices)
+        for(const auto& vec : vertices)
         {
             // Position
-            out << "v " << -vec.Position.x << ' ' << vec.Position.z << ' ' << vec.Position.y << std::endl;
+            out << "v " << -vec.Position.x << ' ' << vec.Position.z << ' ' << vec.Position.y << '\n';
 
             // Texture coordinates
 #ifdef DECAY_BSP_ST_INSTEAD_OF_UV
             #warning Exporting OBJ will use ST texture coordinates instead of UV
-            out << "vt " << vec.ST.s << ' ' << 1-vec.ST.t << std::endl;
+            out << "vt " << vec.ST.s << ' ' << 1-vec.ST.t << '\n';
 #else
-            out << "vt " << vec.UV.x << ' ' << 1-vec.UV.y << std::endl;
+            out << "vt " << vec.UV.x << ' ' << 1-vec.UV.y << '\n';
 #endif
-        }
 
-        out.flush();
-
-        // Indices
-        //for(auto& model : Models)
-        for(std::size_t mi = 0; mi < Models.size(); mi++)
-        {
-            out << std::endl;
+            // Normal
+            out << "vn " << -vec.Normal.x << ' ' << vec.Normal.z << ' ' << vec.Normal.y << '\n';
+        }
+    }
+    void BspTree::ExportObjModelName(std::string& text, std::size_t modelIndex)
+    {
+        ObjWriter out(text);
+        out << '\n';
+        out << "o Model_" << static_cast<uint32_t>(modelIndex) << '\n';
+    }
+    void BspTree::ExportObjFaces(std::string& text, const Model& model, const Model::TextureRange& range, uint32_t firstIndex) const
+    {
+        ObjWriter out(text);
+        out.Reserve(range.Count * 18);
 
-            out << "o Model_" << mi << std::endl;
+        const auto& indices = model.Indices;
 
-            for(auto& kvp : Models[mi]->Indices)
-            {
-                out << std::endl;
+        out << '\n';
 
-                out << "g texture_" << Textures[kvp.first].Name << std::endl;
-                out << "usemtl texture_" << Textures[kvp.first].Name << std::endl;
+        out << "g texture_" << Textures[range.TextureId].Name << '\n';
+        out << "usemtl texture_" << Textures[range.TextureId].Name << '\n';
 
-                auto& indices = kvp.second;
+        const std::size_t indicesEnd = range.Offset + range.Count;
 
 #ifdef BSP_OBJ_POLYGONS
-                bool prevPolygon = false;
+        bool prevPolygon = false;
 #endif
 
-                R_ASSERT(indices.size() % 3 == 0, "Indices does not form a triangle");
-                for(std::size_t ii = 0; ii < indices.size(); ii += 3)
-                {
-                    // +1 because OBJ starts at 1 instead of 0
-                    uint16_t i0 = indices[ii + 0] + 1;
-                    uint16_t i1 = indices[ii + 1] + 1;
-                    uint16_t i2 = indices[ii + 2] + 1;
+        R_ASSERT(range.Count % 3 == 0, "Indices does not form a triangle");
+        for(std::size_t ii = range.Offset; ii < indicesEnd; ii += 3)
+        {
+            R_ASSERT(indices[ii + 0] < model.VertexCount, "Vertex index of face triangle is outside of bounds");
+            R_ASSERT(indices[ii + 1] < model.VertexCount, "Vertex index of face triangle is outside of bounds");
+            R_ASSERT(indices[ii + 2] < model.VertexCount, "Vertex index of face triangle is outside of bounds");
 
-                    R_ASSERT(i0 <= Vertices.size(), "Vertex index of face triangle is outside of bounds");
-                    R_ASSERT(i1 <= Vertices.size(), "Vertex index of face triangle is outside of bounds");
-                    R_ASSERT(i2 <= Vertices.size(), "Vertex index of face triangle is outside of bounds");
+            uint32_t i0 = firstIndex + indices[ii + 0];
+            uint32_t i1 = firstIndex + indices[ii + 1];
+            uint32_t i2 = firstIndex + indices[ii + 2];
 
 #ifdef BSP_OBJ_POLYGONS
-                    if(prevPolygon)
-                        out  << ' ' << i2 << '/' << i2;
-                    else
-                        out << "f " << i0 << '/' << i0 << ' ' << i1 << '/' << i1 << ' ' << i2 << '/' << i2;
+            if(prevPolygon)
+                out  << ' ' << i2 << '/' << i2 << '/' << i2;
+            else
+                out << "f " << i0 << '/' << i0 << '/' << i0 << ' ' << i1 << '/' << i1 << '/' << i1 << ' ' << i2 << '/' << i2 << '/' << i2;
 #else
-                    out << "f " << i0 << '/' << i0 << ' ' << i1 << '/' << i1 << ' ' << i2 << '/' << i2 << std::endl;
+            out << "f " << i0 << '/' << i0 << '/' << i0 << ' ' << i1 << '/' << i1 << '/' << i1 << ' ' << i2 << '/' << i2 << '/' << i2 << '\n';
 #endif
 
 #ifdef BSP_OBJ_POLYGONS
-                    // Is there another triangle?
-                    if(ii + 3 < indices.size())
-                    {
-                        uint16_t i3 = indices[ii + 0 + 3] + 1;
-                        uint16_t i4 = indices[ii + 1 + 3] + 1;
-                        uint16_t i5 = indices[ii + 2 + 3] + 1;
-
-                        // Format of output from polygon->triangles function
-                        // [ii + 0] is same
-                        // old [ii + 2] -> new [ii + 1]
-                        // Only new index is new [ii + 2]
-                        prevPolygon = (i0 == i3 && i2 == i4);
-
-                        // Next triangle is not from same polygon
-                        if(!prevPolygon)
-                            out << std::endl;
-                    }
-                    else
-                    {
-                        //prevPolygon = false; // Not needed as there are no more indices
-                        out << std::endl;
-                    }
+            // Is there another triangle?
+            if(ii + 3 < indicesEnd)
+            {
+                uint32_t i3 = firstIndex + indices[ii + 0 + 3];
+                uint32_t i4 = firstIndex + indices[ii + 1 + 3];
+
+                // Format of output from polygon->triangles function
+                // [ii + 0] is same
+                // old [ii + 2] -> new [ii + 1]
+                // Only new index is new [ii + 2]
+                prevPolygon = (i0 == i3 && i2 == i4);
+
+                // Next triangle is not from same polygon
+                if(!prevPolygon)
+                    out << '\n';
+            }
+            else
+            {
+                //prevPolygon = false; // Not needed as there are no more indices
+                out << '\n';
+            }
 #else
-                    out << std::endl;
+            out << '\n';
 #endif
-                }
-            }
+        }
+    }
+    BspTree::ModelMesh BspTree::GetModelMesh(std::size_t modelIndex) const
+    {
+        R_ASSERT(modelIndex < Models.size(), "Model index is outside of bounds");
+        const std::shared_ptr<Model>& model = Models[modelIndex];
 
-            out.flush();
+        ModelMesh mesh;
+        mesh.ModelIndex = static_cast<uint32_t>(modelIndex);
+        mesh.Source = model;
+        mesh.Origin = model->Origin;
+
+        // World has no entity with a model
+        if(modelIndex != 0)
+        {
+            mesh.EntityIndex = Entities.FindModelEntity(static_cast<int>(modelIndex));
+            if(mesh.EntityIndex != BspEntities::NoEntity)
+            {
+                const BspEntities::Entity& entity = Entities[mesh.EntityIndex];
+                mesh.Origin += ParseEntityVector(entity, "origin");
+                if(!UsesAnglesAsMoveDirection(entity))
+                    mesh.Angles = ParseEntityAngles(entity);
+            }
         }
+
+        const auto vertices = GetModelVertices(*model);
+        mesh.Vertices.assign(vertices.begin(), vertices.end());
+        for(Vertex& vertex : mesh.Vertices)
+            vertex.Position -= model->Origin;
+
+        return mesh;
+    }
+    glm::vec3 BspTree::ModelMesh::ToWorld(const glm::vec3& position) const noexcept
+    {
+        const glm::vec3 radians = Angles * (3.14159265358979323846f / 180.0f);
+        const float sp = std::sin(radians.x), cp = std::cos(radians.x);
+        const float sy = std::sin(radians.y), cy = std::cos(radians.y);
+        const float sr = std::sin(radians.z), cr = std::cos(radians.z);
+
+        // Roll (X)
+        glm::vec3 p = { position.x, position.y * cr - position.z * sr, position.y * sr + position.z * cr };
+        // Pitch (Y)
+        p = { p.x * cp + p.z * sp, p.y, -p.x * sp + p.z * cp };
+        // Yaw (Z)
+        p = { p.x * cy - p.y * sy, p.x * sy + p.y * cy, p.z };
+
+        return Origin + p;
     }
     void BspTree::ExportMtl(const std::filesystem::path& filename, const std::filesystem::path& texturePath, const std::string& textureExtension) const
     {
@@ -410,7 +941,7 @@ namespace Decay::Bsp::v30
         {
             std::vector<glm::u8vec4> rgba;
             if(texture.HasData())
-                rgba = texture.AsRgba();
+                rgba = Bsp->GetTextureRgba(texture);
             else // No data
             {
                 if(!dummyForMissing)
@@ -433,142 +964,202 @@ namespace Decay::Bsp::v30
             );
         }
     }
-    void BspTree::AddLight(glm::uvec2 size, const glm::u8vec3* data, glm::vec2& out_start, glm::vec2& out_end)
+    void BspTree::PackLightmaps(std::vector<PreparedFace>& faces, std::size_t threadCount)
     {
-        // Insert into texture
-        float w1 = 1.0f / Light.Width;
-        float h1 = 1.0f / Light.Height;
+        std::vector<std::size_t> withLightmap;
+        std::size_t layerCount = 1;
+        for(std::size_t i = 0; i < faces.size(); i++)
+        {
+            PreparedFace& face = faces[i];
+            if(face.Lightmap == nullptr)
+                continue;
+            layerCount = std::max(layerCount, face.LightmapCount);
+
+            R_ASSERT(
+                face.LightmapSize.x <= static_cast<int>(Lightmap::MaxSize) && face.LightmapSize.y <= static_cast<int>(Lightmap::MaxSize),
+                "Lightmap of face is bigger than whole lightmap page"
+            );
+            face.LightmapBlockSize = face.LightmapSize;
+            face.LightmapSource = i;
+            withLightmap.emplace_back(i);
+        }
+
+#ifdef BSP_LIGHTMAP_DEDUP
+        DeduplicateLightmaps(faces, withLightmap, threadCount);
+#endif
+
+        // Only owners of blocks are placed - tallest first (then widest), equal blocks keep order of faces
+        std::vector<std::size_t> order;
+        for(std::size_t i : withLightmap)
         {
-            //TODO Optimize
-            // Check few pixels (left, right, middle) before checking whole row?
-            for(uint32_t y = 0; y < Light.Height - size.y; y++)
+            if(faces[i].LightmapSource == i)
+                order.emplace_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&faces](std::size_t a, std::size_t b)
+        {
+            const glm::uvec2 sizeA = faces[a].LightmapBlockSize;
+            const glm::uvec2 sizeB = faces[b].LightmapBlockSize;
+            return sizeA.y != sizeB.y ? sizeA.y > sizeB.y : sizeA.x > sizeB.x;
+        });
+
+        // Smallest page which fits everything, more pages only when even `MaxSize` is not enough
+        uint32_t pageSize = Lightmap::InitSize;
+        std::vector<SkylinePacker> pages;
+        for(bool packed = false; !packed; )
+        {
+            pages.assign(1, SkylinePacker(pageSize, pageSize));
+            packed = true;
+
+            for(std::size_t i : order)
             {
-                for(uint32_t x = 0; x < Light.Width - size.x; x++)
+                PreparedFace& face = faces[i];
+                const glm::uvec2 size = face.LightmapBlockSize;
+
+                std::size_t page = 0;
+                while(page < pages.size() && !pages[page].Insert(size, face.LightmapPosition))
+                    page++;
+
+                if(page == pages.size())
                 {
-                    if(Light.CanInsert(x, y, size))
+                    if(pageSize < Lightmap::MaxSize)
                     {
-                        Light.Insert(x, y, size, data);
-
-                        out_start = {
-                            x * w1,
-                            y * h1
-                        };
-                        out_end = {
-                            static_cast<float>(x + size.x) * w1,
-                            static_cast<float>(y + size.y) * h1
-                        };
-                        return; // Successfully added
+                        packed = false;
+                        pageSize *= 2;
+                        break;
                     }
+
+                    pages.emplace_back(pageSize, pageSize);
+                    R_ASSERT(pages.back().Insert(size, face.LightmapPosition), "Lightmap does not fit into empty page");
                 }
+                face.LightmapPage = page;
             }
-            // No space to insert into!
         }
 
-        // Resize texture
+        // Faces sharing a block get placement of its owner
+        for(std::size_t i : withLightmap)
         {
-            const uint32_t w = Light.Width;
-            const uint32_t h = Light.Height;
-
-            if(w >= BspTree::Lightmap::MaxSize || h >= BspTree::Lightmap::MaxSize)
-                throw std::runtime_error("Lightmap is too big");
-
-            Light.Width *= 2;
-            Light.Height *= 2;
-
-            const std::size_t dataSize_old = w * h;
-            const std::size_t dataSize = dataSize_old * 4;
-            Light.Data.resize(dataSize);
-            Light.Used.resize(dataSize);
+            PreparedFace& face = faces[i];
+            if(face.LightmapSource == i)
+                continue;
 
-            auto data_ptr = Light.Data.begin();
-            auto used_ptr = Light.Used.begin();
+            face.LightmapPage = faces[face.LightmapSource].LightmapPage;
+            face.LightmapPosition = faces[face.LightmapSource].LightmapPosition;
+        }
 
 #ifdef DEBUG
-            auto rgb = glm::u8vec3(0xFF, 0x00, 0x7F);
+        const glm::u8vec3 filler = Lightmap::InitColor;
 #else
-            auto& rgb = Bsp->GetRawLighting()[Bsp->GetLightingCount() / 2];
+        // Middle of the lighting lump is used as filler, better than black around blocks when filtered
+        const glm::u8vec3 filler = Bsp->GetLightingCount() == 0 ? Lightmap::InitColor : Bsp->GetRawLighting()[Bsp->GetLightingCount() / 2];
 #endif
+        // Layers share the placement, there are as many of them as the face with most styles needs
+        Lightmaps.assign(pages.size(), Lightmap(pageSize, pageSize, layerCount, filler));
 
-            // Move content of Light.Data & Light.
-            // Use to top-left corner instead of top quarter.
-            for(int64_t oldIndex = dataSize_old, newIndex = dataSize / 2 - w; oldIndex > 0; oldIndex -= w, newIndex -= Light.Width)
-            {
-                R_ASSERT(newIndex >= 0, "Invalid new index");
+        for(std::size_t i : withLightmap)
+        {
+            const PreparedFace& face = faces[i];
 
-                int64_t oldIndex_new = oldIndex + w;
-                R_ASSERT(oldIndex_new <= dataSize, "Repositioned old index is outside of the lightmap");
+            Lightmap::Block block = {};
+            block.Position = face.LightmapPosition;
+            block.Size = face.LightmapBlockSize;
+            block.FaceSize = face.LightmapSize;
+            block.Face = face.Face;
+            for(std::size_t layer = 0; layer < BspFile::MaxLightStyles; layer++)
+                block.Styles[layer] = layer < face.LightmapCount ? face.LightingStyles[layer] : BspFile::UnusedLightStyle;
 
-                // Data
-                std::move(
-                    data_ptr + oldIndex,
-                    data_ptr + oldIndex_new,
-                    data_ptr + newIndex
-                );
-                std::fill(
-                    data_ptr + oldIndex,
-                    data_ptr + oldIndex_new,
-                    rgb
-                );
+            Lightmaps[face.LightmapPage].Blocks.emplace_back(block);
+        }
 
-                // Used
-                std::move(
-                    used_ptr + oldIndex,
-                    used_ptr + oldIndex_new,
-                    used_ptr + newIndex
-                );
-                std::fill(
-                    used_ptr + oldIndex,
-                    used_ptr + oldIndex_new,
-                    false
-                );
+        // Placed blocks do not overlap, pixels can be copied in parallel
+        ParallelFor(order.size(), threadCount, [this, &faces, &order](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t oi = begin; oi < end; oi++)
+            {
+                const PreparedFace& face = faces[order[oi]];
+                const std::size_t lightmapLength = face.LightmapSize.x * face.LightmapSize.y;
+                for(std::size_t layer = 0; layer < face.LightmapCount; layer++)
+                    Lightmaps[face.LightmapPage].Insert(layer, face.LightmapPosition.x, face.LightmapPosition.y, face.LightmapBlockSize, face.Lightmap + layer * lightmapLength);
             }
+        });
+    }
+#ifdef BSP_LIGHTMAP_DEDUP
+    void BspTree::DeduplicateLightmaps(std::vector<PreparedFace>& faces, const std::vector<std::size_t>& withLightmap, std::size_t threadCount)
+    {
+        // Texels of one layer of the block, after collapsing it is only the first texel
+        const auto layerTexels = [](const PreparedFace& face, std::size_t layer)
+        {
+            const std::size_t lightmapLength = face.LightmapSize.x * face.LightmapSize.y;
+            return std::span<const glm::u8vec3>(face.Lightmap + layer * lightmapLength, face.LightmapBlockSize.x * face.LightmapBlockSize.y);
+        };
 
-            // Fill new area (lower half)
-            std::fill(
-                Light.Data.begin() + (dataSize / 2),
-                Light.Data.end(),
-                rgb
-            );
-        }
+        // Collapse and hash in parallel, every face is touched by one thread only
+        std::vector<uint64_t> hashes(withLightmap.size());
+        ParallelFor(withLightmap.size(), threadCount, [&faces, &withLightmap, &hashes, &layerTexels](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t wi = begin; wi < end; wi++)
+            {
+                PreparedFace& face = faces[withLightmap[wi]];
 
-#ifndef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
-        // Recalculate UV
-        for(auto& vertex : Vertices)
-            vertex.LightUV *= 0.5f;
-#endif
+                bool singleColour = true;
+                for(std::size_t layer = 0; layer < face.LightmapCount && singleColour; layer++)
+                {
+                    const auto texels = layerTexels(face, layer);
+                    singleColour = std::all_of(texels.begin(), texels.end(), [&texels](const glm::u8vec3& texel) { return texel == texels[0]; });
+                }
+                if(singleColour)
+                {
+                    face.LightmapBlockSize = {1, 1};
+                    face.LightmapCollapsed = true;
+                }
+
+                // FNV-1a of size, styles and texels
+                uint64_t hash = 0xCBF29CE484222325ull;
+                const auto mix = [&hash](const void* data, std::size_t size)
+                {
+                    for(std::size_t i = 0; i < size; i++)
+                        hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 0x100000001B3ull;
+                };
+                mix(&face.LightmapBlockSize, sizeof(face.LightmapBlockSize));
+                mix(face.LightingStyles, face.LightmapCount);
+                for(std::size_t layer = 0; layer < face.LightmapCount; layer++)
+                {
+                    const auto texels = layerTexels(face, layer);
+                    mix(texels.data(), texels.size_bytes());
+                }
+                hashes[wi] = hash;
+            }
+        });
 
-        // Insert into texture
-        // Same as above but skips previous pixels
+        // First face with given block owns it, later ones share it
+        std::unordered_map<uint64_t, std::vector<std::size_t>> owners;
+        for(std::size_t wi = 0; wi < withLightmap.size(); wi++)
         {
-            //TODO Optimize
-            // - Check few pixels (left, right, middle) before checking whole row?
-            /*
-            R_ASSERT(Light.Height / 2 - 16 >= 0);
-            R_ASSERT(Light.Width / 2 - 16 >= 0);
-            */
-            for(uint32_t y = Light.Height / 2 - 16; y < Light.Height - size.y; y++)
+            PreparedFace& face = faces[withLightmap[wi]];
+            std::vector<std::size_t>& candidates = owners[hashes[wi]];
+
+            const auto owner = std::find_if(candidates.begin(), candidates.end(), [&faces, &face, &layerTexels](std::size_t candidate)
             {
-                for(uint32_t x = Light.Width / 2 - 16; x < Light.Width - size.x; x++)
+                const PreparedFace& other = faces[candidate];
+                if(other.LightmapBlockSize != face.LightmapBlockSize || other.LightmapCount != face.LightmapCount)
+                    return false;
+                if(!std::equal(face.LightingStyles, face.LightingStyles + face.LightmapCount, other.LightingStyles))
+                    return false;
+
+                for(std::size_t layer = 0; layer < face.LightmapCount; layer++)
                 {
-                    if(Light.CanInsert(x, y, size))
-                    {
-                        Light.Insert(x, y, size, data);
-
-                        out_start = {
-                            x * w1,
-                            y * h1
-                        };
-                        out_end = {
-                            static_cast<float>(x + size.x) * w1,
-                            static_cast<float>(y + size.y) * h1
-                        };
-                        return; // Successfully added
-                    }
+                    const auto texels = layerTexels(face, layer);
+                    const auto otherTexels = layerTexels(other, layer);
+                    if(!std::equal(texels.begin(), texels.end(), otherTexels.begin()))
+                        return false;
                 }
-            }
-            // No space to insert into!
-        }
+                return true;
+            });
 
-        throw std::runtime_error("Could not insert into resized lightmap");
+            if(owner != candidates.end())
+                face.LightmapSource = *owner;
+            else
+                candidates.emplace_back(withLightmap[wi]);
+        }
     }
+#endif
 }
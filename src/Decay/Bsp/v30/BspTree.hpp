@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <limits>
+#include <span>
 
 #include "Decay/Bsp/v30/BspFile.hpp"
 #include "Decay/Bsp/v30/BspEntities.hpp"
@@ -10,11 +13,15 @@ namespace Decay::Bsp::v30
     class BspTree
     {
     public:
-        explicit BspTree(std::shared_ptr<BspFile> bsp);
+        /// Faces are prepared by `threadCount` threads (0 = number of CPU threads),
+        /// vertices and lightmaps are then added in the order of faces, so the result does not depend on `threadCount`.
+        /// Normals of faces with the same texture in one model are smoothed where they meet under `smoothingAngle` degrees (0 = flat normals).
+        explicit BspTree(std::shared_ptr<BspFile> bsp, std::size_t threadCount = 0, float smoothingAngle = 0);
 
     public:
         const std::shared_ptr<BspFile> Bsp;
-        const std::vector<Wad::Wad3::WadFile::Texture> Textures;
+        /// Only names and sizes, pixels are decoded by `GetTextureRgba`
+        const std::vector<BspFile::TextureInfo> Textures;
 
         const BspEntities Entities;
 
@@ -35,33 +42,95 @@ namespace Decay::Bsp::v30
 
             /// Lightmap coordinates
 #ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
-            /// 0.0 to texture size
+            /// 0.0 to size of the lightmap page (in texels)
             glm::vec2 LightST;
 #else
             /// 0.0 to 1.0
             glm::vec2 LightUV;
 #endif
+            /// Index of `BspTree::Lightmaps` the lightmap coordinates point into (same coordinates in every layer)
+            uint32_t LightmapPage;
+
+            /// Unit vector in front of the face (plane normal flipped by `PlaneSide`), smoothed between faces when enabled
+            glm::vec3 Normal;
+            /// Texture S axis along the face, `cross(Normal, Tangent.xyz) * Tangent.w` follows texture T axis
+            glm::vec4 Tangent;
 
         public:
             inline bool operator==(const Vertex& other) const
             {
 #ifdef DECAY_BSP_ST_INSTEAD_OF_UV
-                return Position == other.Position && ST == other.ST;
+                const bool sameUv = ST == other.ST;
 #else
-                return Position == other.Position && UV == other.UV;
+                const bool sameUv = UV == other.UV;
 #endif
+#ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
+                const bool sameLightUv = LightST == other.LightST;
+#else
+                const bool sameLightUv = LightUV == other.LightUV;
+#endif
+                return Position == other.Position && sameUv && sameLightUv && LightmapPage == other.LightmapPage && Normal == other.Normal && Tangent == other.Tangent;
             }
             inline bool operator!=(const Vertex& other) const
             {
-#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
-                return Position != other.Position || ST != other.ST;
-#else
-                return Position != other.Position || UV != other.UV;
-#endif
+                return !(*this == other);
             }
         };
         std::vector<Vertex> Vertices;
 
+    public:
+        /// Vertex indices stored as 16-bit when every index fits, otherwise as 32-bit
+        class IndexBuffer
+        {
+        public:
+            /// 16-bit indices can address this many vertices
+            static const std::size_t MaxNarrowVertices = 1u << 16u;
+
+        public:
+            IndexBuffer() = default;
+            IndexBuffer(const std::vector<uint32_t>& indices, bool wide) : m_Wide(wide)
+            {
+                if(wide)
+                    m_Indices32 = indices;
+                else
+                {
+                    m_Indices16.reserve(indices.size());
+                    for(uint32_t index : indices)
+                    {
+                        D_ASSERT(index < MaxNarrowVertices, "Index does not fit into 16 bits");
+                        m_Indices16.emplace_back(static_cast<uint16_t>(index));
+                    }
+                }
+            }
+
+        private:
+            bool m_Wide = false;
+            std::vector<uint16_t> m_Indices16;
+            std::vector<uint32_t> m_Indices32;
+
+        public:
+            [[nodiscard]] inline bool IsWide() const noexcept { return m_Wide; }
+            /// Size of one index in bytes
+            [[nodiscard]] inline std::size_t GetIndexSize() const noexcept { return m_Wide ? sizeof(uint32_t) : sizeof(uint16_t); }
+
+            [[nodiscard]] inline std::size_t size() const noexcept { return m_Wide ? m_Indices32.size() : m_Indices16.size(); }
+            [[nodiscard]] inline bool empty() const noexcept { return size() == 0; }
+            [[nodiscard]] inline uint32_t operator[](std::size_t i) const noexcept { return m_Wide ? m_Indices32[i] : m_Indices16[i]; }
+            /// `size() * GetIndexSize()` bytes, ready for upload into GPU
+            [[nodiscard]] inline const void* data() const noexcept { return m_Wide ? static_cast<const void*>(m_Indices32.data()) : static_cast<const void*>(m_Indices16.data()); }
+
+            [[nodiscard]] inline std::span<const uint16_t> Get16() const
+            {
+                R_ASSERT(!m_Wide, "Index buffer is 32-bit");
+                return m_Indices16;
+            }
+            [[nodiscard]] inline std::span<const uint32_t> Get32() const
+            {
+                R_ASSERT(m_Wide, "Index buffer is 16-bit");
+                return m_Indices32;
+            }
+        };
+
     public:
         class Model : std::enable_shared_from_this<Model>
         {
@@ -77,8 +146,36 @@ namespace Decay::Bsp::v30
 
             glm::vec3 Origin;
 
-            /// [ textureIndex ] = vertex indices
-            std::map<uint16_t, std::vector<uint16_t>> Indices;
+            /// Vertices of this model are `BspTree::Vertices[BaseVertex]` to `[BaseVertex + VertexCount - 1]`
+            uint32_t BaseVertex = 0;
+            uint32_t VertexCount = 0;
+
+            /// Triangles of one texture are `Count` indices from `Offset` in `Indices`
+            struct TextureRange
+            {
+                uint16_t TextureId;
+                uint32_t Offset;
+                uint32_t Count;
+            };
+
+            /// Vertex indices of all triangles (relative to `BaseVertex`), grouped by texture and in order of faces inside of a group.
+            /// 16-bit when the model has at most `IndexBuffer::MaxNarrowVertices` vertices.
+            IndexBuffer Indices;
+            /// Sorted by `TextureId`, every used texture once
+            std::vector<TextureRange> TextureRanges;
+            /// Index of `BspFile` face for every triangle of `Indices`
+            std::vector<uint32_t> TriangleFaces;
+
+        public:
+            /// `nullptr` when the model does not use the texture
+            [[nodiscard]] inline const TextureRange* FindTexture(uint16_t textureId) const noexcept
+            {
+                const auto it = std::lower_bound(
+                    TextureRanges.begin(), TextureRanges.end(), textureId,
+                    [](const TextureRange& range, uint16_t id) { return range.TextureId < id; }
+                );
+                return it != TextureRanges.end() && it->TextureId == textureId ? &*it : nullptr;
+            }
         };
         std::vector<std::shared_ptr<Model>> Models;
 
@@ -87,6 +184,7 @@ namespace Decay::Bsp::v30
         {
         public:
             static const uint32_t InitSize = 512; // Used to be 256 but most official map had 3 or 4 of them
+            /// Lightmaps which do not fit into one page of this size are split into more pages
             static const uint32_t MaxSize = 1u << 12u; // 4096
 
 #ifdef DEBUG
@@ -96,88 +194,68 @@ namespace Decay::Bsp::v30
 #endif
 
         public:
-            explicit Lightmap(uint32_t width = InitSize, uint32_t height = InitSize)
+            /// First layer is filled with `fill`, others are black (no light from missing styles)
+            explicit Lightmap(uint32_t width = InitSize, uint32_t height = InitSize, std::size_t layerCount = 1, glm::u8vec3 fill = InitColor)
              : Width(width), Height(height),
-               Data(width * height, InitColor),
-               Used(width * height), UsedRanges()
+               Layers(layerCount, std::vector<glm::u8vec3>(width * height, glm::u8vec3(0))), Blocks()
             {
-                /*
-                R_ASSERT(Height / 2 - 16 >= 0);
-                R_ASSERT(Width / 2 - 16 >= 0);
-                */
+                R_ASSERT(layerCount >= 1 && layerCount <= BspFile::MaxLightStyles, "Invalid number of lightmap layers");
+                std::fill(Layers[0].begin(), Layers[0].end(), fill);
             }
 
         public:
             uint32_t Width, Height;
-            std::vector<glm::u8vec3> Data;
+            /// [ styleSlot ] = pixels, block of a face has lightmap of its `LightingStyles[styleSlot]` at the same place in every layer
+            std::vector<std::vector<glm::u8vec3>> Layers;
 
         public:
-            std::vector<bool> Used;
-            std::vector<glm::u32vec4> UsedRanges;
-
-        public:
-            bool CanInsert(uint32_t insert_x, uint32_t insert_y, glm::uvec2 size)
+            struct Block
             {
-                if(size.x + insert_x >= Width) [[unlikely]]
-                    return false;
-                if(size.y + insert_y >= Height) [[unlikely]]
-                    return false;
-
-                for(uint32_t y = 0; y < size.y; y++)
-                {
-                    std::size_t yi = (y + insert_y) * Width;
-                    for(uint32_t x = 0; x < size.x; x++)
-                    {
-                        if(Used[yi + x + insert_x])
-                            return false;
-                    }
-                }
+                glm::uvec2 Position;
+                glm::uvec2 Size;
+                /// Size of the face's lightmap in BSP, bigger than `Size` when lightmap of a single colour was collapsed
+                glm::uvec2 FaceSize;
+                /// Index of `BspFile` face
+                uint32_t Face;
+                /// Style stored in each layer, `BspFile::UnusedLightStyle` = nothing in that layer
+                uint8_t Styles[BspFile::MaxLightStyles];
+            };
+            /// Block of every face, faces with identical lightmaps share the same place (with `BSP_LIGHTMAP_DEDUP`)
+            std::vector<Block> Blocks;
 
-                return true;
-            }
-            void Insert(uint32_t insert_x, uint32_t insert_y, glm::uvec2 size, const glm::u8vec3* data)
+        public:
+            /// Copies pixels of the block into one layer, placement is decided by the packer.
+            /// Does not touch `Blocks` so blocks which do not overlap can be inserted from many threads at once.
+            void Insert(std::size_t layer, uint32_t insert_x, uint32_t insert_y, glm::uvec2 size, const glm::u8vec3* data)
             {
-                // Already checked by `CanInsert`, no need to check here (in Release)
-                D_ASSERT(size.x + insert_x < Width, "Attempting to insert outside of lightmap (width failed)");
-                D_ASSERT(size.y + insert_y < Height, "Attempting to insert outside of lightmap (height failed)");
-
-                // Mark range as used
-                UsedRanges.emplace_back(
-                        insert_x, insert_y,
-                        size.x, size.y
-                );
+                D_ASSERT(layer < Layers.size(), "Attempting to insert into layer which does not exist");
+                D_ASSERT(size.x + insert_x <= Width, "Attempting to insert outside of lightmap (width failed)");
+                D_ASSERT(size.y + insert_y <= Height, "Attempting to insert outside of lightmap (height failed)");
 
                 for(uint32_t y = 0; y < size.y; y++)
                 {
                     std::size_t yi = (y + insert_y) * Width;
                     std::size_t insert_yi = y * size.x;
 
-                    // Mark pixels as "Used"
-                    std::fill(
-                            Used.begin() + (yi + insert_x),
-                            Used.begin() + ((yi + insert_x) + size.x),
-                            true
-                    );
-
                     // Copy pixel data
                     std::copy(
                             data + insert_yi,
                             data + (insert_yi + size.x),
-                            Data.data() + (yi + insert_x)
+                            Layers[layer].data() + (yi + insert_x)
                     );
                 }
             }
         };
-        Lightmap Light = Lightmap();
-    public:
-        void AddLight(glm::uvec2 size, const glm::u8vec3* data, glm::vec2& out_start, glm::vec2& out_end);
+        /// Pages of the lightmap atlas, all of them have the same size (there is always at least one)
+        std::vector<Lightmap> Lightmaps;
 
     public:
         class Face
         {
         public:
             uint16_t TextureId;
-            std::vector<uint16_t> Indices;
+            /// Indices into `BspTree::Vertices`
+            std::vector<uint32_t> Indices;
 
             /// [0] = Type of Light
             /// [1] = Base Light (0xFF = dark, 0x00 = light)
@@ -186,73 +264,293 @@ namespace Decay::Bsp::v30
         };
 
     private:
-        [[nodiscard]] std::shared_ptr<Model> ProcessModel(const BspFile::Model& model)
+        /// Vertex of a face before it is added into `Vertices`
+        struct PreparedCorner
+        {
+            glm::vec3 Position;
+            /// UV or ST, based on `DECAY_BSP_ST_INSTEAD_OF_UV`
+            glm::vec2 TextureCoordinates;
+            /// Texel position used for lightmap coordinates
+            float S, T;
+            /// Normal of the face, replaced by `SmoothNormals`
+            glm::vec3 Normal;
+        };
+        /// Everything about a face that does not depend on other faces, can be done from many threads at once
+        struct PreparedFace
+        {
+            /// Index of `BspFile` face
+            uint32_t Face = 0;
+            uint16_t TextureId = 0;
+            uint8_t LightingStyles[4] = {};
+
+            /// Range in the array of `PreparedCorner`s, no corners = empty face
+            std::size_t FirstCorner = 0;
+            std::size_t CornerCount = 0;
+
+            /// `nullptr` when the face has no lightmap, otherwise `LightmapCount` lightmaps one after another
+            const glm::u8vec3* Lightmap = nullptr;
+            std::size_t LightmapCount = 0;
+            glm::ivec2 LightmapSize = {1, 1};
+            float MinS = 0, MinT = 0;
+
+            /// Placement in `Lightmaps`, set by `PackLightmaps`
+            uint32_t LightmapPage = 0;
+            glm::uvec2 LightmapPosition = {0, 0};
+            /// Size of the block in `Lightmaps`, `{1, 1}` when `LightmapCollapsed`
+            glm::uvec2 LightmapBlockSize = {0, 0};
+            /// Every layer of the lightmap has a single colour, the whole face uses the centre of one texel
+            bool LightmapCollapsed = false;
+            /// Index of prepared face which owns the block, this one unless it has the same lightmap as a previous face
+            std::size_t LightmapSource = 0;
+
+            /// Front normal and tangent of the face (see `Vertex`)
+            glm::vec3 Normal = {0, 0, 0};
+            glm::vec4 Tangent = {0, 0, 0, 0};
+        };
+
+        void PrepareFace(const BspFile::Face& face, PreparedFace& out, PreparedCorner* corners) const;
+        /// Places lightmaps of all faces at once (tallest first) and fills `Lightmaps`
+        void PackLightmaps(std::vector<PreparedFace>& faces, std::size_t threadCount);
+#ifdef BSP_LIGHTMAP_DEDUP
+        /// Collapses single colour lightmaps and points faces with the same lightmap to the first one
+        static void DeduplicateLightmaps(std::vector<PreparedFace>& faces, const std::vector<std::size_t>& withLightmap, std::size_t threadCount);
+#endif
+        /// Averages normals of corners at the same position of faces with the same texture, weighted by corner angle
+        static void SmoothNormals(const PreparedFace* faces, std::size_t faceCount, PreparedCorner* corners, float smoothingAngle);
+        /// Adds the lightmap and vertices of the face, must be called in the same order as the serial build would
+        Face ProcessFace(const PreparedFace& face, const PreparedCorner* corners);
+
+        [[nodiscard]] std::shared_ptr<Model> ProcessModel(const BspFile::Model& model, const PreparedFace* faces, const PreparedCorner* corners)
         {
             std::shared_ptr<Model> smartModel = std::make_shared<Model>(
                 model.bbMin, model.bbMax,
                 model.Origin
             );
+            smartModel->BaseVertex = Vertices.size();
 
+#ifdef BSP_NO_DUPLICATES
+            // Vertices are shared only inside of one model, so every model has its own continuous range
+            m_VertexLookup.clear();
+            m_LookupBaseVertex = smartModel->BaseVertex;
+#endif
+
+            // Indices of faces in order of faces, then stable-sorted by texture
+            struct FaceRange
+            {
+                uint16_t TextureId;
+                uint32_t Face;
+                std::size_t Offset;
+                std::size_t Count;
+            };
+            std::vector<FaceRange> faceRanges;
+            std::vector<uint32_t> faceIndices;
+            faceRanges.reserve(model.FaceCount);
             for(int32_t fi = model.FirstFaceIndex, fii = 0; fii < model.FaceCount; fi++, fii++)
             {
-                const BspFile::Face& face = Bsp->GetRawFaces()[fi];
-                Face smartFace = ProcessFace(face);
-
-                auto& indices = smartModel->Indices[smartFace.TextureId];
+                Face smartFace = ProcessFace(faces[fii], corners);
                 R_ASSERT(smartFace.Indices.size() % 3 == 0, "Processed face is not made of triangles - not divisible by 3");
-                indices.reserve(smartFace.Indices.size());
-                std::copy(smartFace.Indices.begin(), smartFace.Indices.end(), back_inserter(indices));
+                if(smartFace.Indices.empty())
+                    continue;
+
+                faceRanges.push_back({ smartFace.TextureId, static_cast<uint32_t>(fi), faceIndices.size(), smartFace.Indices.size() });
+                for(uint32_t index : smartFace.Indices)
+                    faceIndices.emplace_back(index - smartModel->BaseVertex);
+            }
+            std::stable_sort(faceRanges.begin(), faceRanges.end(), [](const FaceRange& a, const FaceRange& b) { return a.TextureId < b.TextureId; });
+
+            std::vector<uint32_t> indices;
+            indices.reserve(faceIndices.size());
+            smartModel->TriangleFaces.reserve(faceIndices.size() / 3);
+            for(const FaceRange& faceRange : faceRanges)
+            {
+                if(smartModel->TextureRanges.empty() || smartModel->TextureRanges.back().TextureId != faceRange.TextureId)
+                    smartModel->TextureRanges.push_back({ faceRange.TextureId, static_cast<uint32_t>(indices.size()), 0 });
+                smartModel->TextureRanges.back().Count += faceRange.Count;
+
+                indices.insert(indices.end(), faceIndices.begin() + faceRange.Offset, faceIndices.begin() + (faceRange.Offset + faceRange.Count));
+                smartModel->TriangleFaces.insert(smartModel->TriangleFaces.end(), faceRange.Count / 3, faceRange.Face);
             }
 
+            smartModel->VertexCount = Vertices.size() - smartModel->BaseVertex;
+            smartModel->Indices = IndexBuffer(indices, smartModel->VertexCount > IndexBuffer::MaxNarrowVertices);
+
             return std::move(smartModel);
         }
 
         /// Call to add vertex while avoiding duplicates.
         /// Calling functions should still use `Vertices.reserve()` to make sure there is enough space when adding multiple vertices.
-        [[nodiscard]] inline uint16_t AddVertex(const Vertex& vertex)
+        [[nodiscard]] inline uint32_t AddVertex(const Vertex& vertex)
         {
 #ifdef BSP_NO_DUPLICATES
+            // Same result as searching vertices of current model for the first equal vertex, but without the linear search
+            if(m_VertexLookup.size() < (Vertices.size() - m_LookupBaseVertex + 1) * 2)
+                GrowVertexLookup();
+
+            const std::size_t mask = m_VertexLookup.size() - 1;
+            for(std::size_t slot = HashVertex(vertex) & mask;; slot = (slot + 1) & mask)
             {
-                auto it = std::find(Vertices.begin(), Vertices.end(), vertex);
-                if(it != Vertices.end())
-                    return it - Vertices.begin();
+                const uint32_t existing = m_VertexLookup[slot];
+                if(existing == VertexLookupEmpty)
+                {
+                    m_VertexLookup[slot] = static_cast<uint32_t>(Vertices.size());
+                    break;
+                }
+                if(Vertices[existing] == vertex)
+                    return existing;
             }
 #endif
 
-            uint16_t index = Vertices.size();
+            R_ASSERT(Vertices.size() < std::numeric_limits<uint32_t>::max(), "Too many vertices");
+            uint32_t index = Vertices.size();
             Vertices.emplace_back(vertex);
             return index;
         }
 
-        Face ProcessFace(const BspFile::Face& face);
+#ifdef BSP_NO_DUPLICATES
+        /// Open-addressing hash table of indices into `Vertices` (linear probing, size is power of 2)
+        std::vector<uint32_t> m_VertexLookup;
+        static constexpr uint32_t VertexLookupEmpty = ~0u;
+        /// First vertex of current model, only vertices after it are in `m_VertexLookup`
+        std::size_t m_LookupBaseVertex = 0;
+
+        /// Hash of everything compared by `Vertex::operator==`
+        [[nodiscard]] static std::size_t HashVertex(const Vertex& vertex) noexcept;
+        void GrowVertexLookup();
+#endif
 
     public:
-        [[nodiscard]] inline std::map<uint16_t, std::vector<uint16_t>> FlattenIndices_Models() const
+        /// [ textureIndex ] = indices into `Vertices` of all models.
+        /// Copies everything, `Model::Indices` with `Model::TextureRanges` can be used directly.
+        [[nodiscard]] inline std::map<uint16_t, std::vector<uint32_t>> FlattenIndices_Models() const
         {
-            std::map<uint16_t, std::vector<uint16_t>> indices = {};
+            std::map<uint16_t, std::vector<uint32_t>> indices = {};
 
             for(auto& model : Models)
             {
-                for(auto& kvp : model->Indices)
+                for(const auto& range : model->TextureRanges)
                 {
-                    std::vector<uint16_t>& ind = indices[kvp.first];
-                    ind.reserve(kvp.second.size());
+                    std::vector<uint32_t>& ind = indices[range.TextureId];
+                    ind.reserve(ind.size() + range.Count);
 
-                    std::copy(kvp.second.begin(), kvp.second.end(), back_inserter(ind));
+                    for(std::size_t i = range.Offset; i < range.Offset + range.Count; i++)
+                        ind.emplace_back(model->BaseVertex + model->Indices[i]);
                 }
             }
 
             return indices;
         }
+        /// Vertices used by the model, its indices start at the beginning of this span
+        [[nodiscard]] inline std::span<const Vertex> GetModelVertices(const Model& model) const
+        {
+            return std::span<const Vertex>(Vertices).subspan(model.BaseVertex, model.VertexCount);
+        }
+
+    public:
+        /// Brush model separated from the world, so brush entities (doors, trains, rotating brushes) can be instanced and moved
+        struct ModelMesh
+        {
+            /// Index of `Models`, 0 = world
+            uint32_t ModelIndex = 0;
+            /// Indices and texture ranges are shared with the model (they are already relative to its first vertex)
+            std::shared_ptr<const Model> Source;
+            /// Index of `Entities` entity with `"model" "*<ModelIndex>"`, `BspEntities::NoEntity` for world or unused model
+            std::size_t EntityIndex = BspEntities::NoEntity;
+
+            /// Vertices of the model with positions relative to `Model::Origin`
+            std::vector<Vertex> Vertices;
+
+            /// `Model::Origin` + `origin` of the entity
+            glm::vec3 Origin = {0, 0, 0};
+            /// Pitch, yaw and roll in degrees (`angles` or `angle` of the entity).
+            /// Stays zero for doors, buttons, triggers, breakables... which the engine spawns without rotation.
+            glm::vec3 Angles = {0, 0, 0};
+
+        public:
+            /// Same order as the engine uses for brush entities - roll around X, pitch around Y, yaw around Z, then `Origin`
+            [[nodiscard]] glm::vec3 ToWorld(const glm::vec3& position) const noexcept;
+        };
+        /// Copies vertices of the model and looks up the entity which owns it
+        [[nodiscard]] ModelMesh GetModelMesh(std::size_t modelIndex) const;
+
+    public:
+        /// Reorders triangles inside of every texture range for the post-transform vertex cache (Tipsify, `cacheSize` entries),
+        /// clusters between cache flushes are sorted to reduce overdraw. Vertices of every model are then sorted by first use.
+        /// `TriangleFaces` follows the triangles. Invalidates vertex indices taken before (`BspBvh`...), exports use the new order.
+        void OptimizeMeshes(uint32_t cacheSize = 16, std::size_t threadCount = 0);
+
+    public:
+        /// Compact vertex for upload into GPU (24 bytes instead of 60), values are decoded by `VertexQuantization` of its model
+        struct PackedVertex
+        {
+            /// Fixed-point position inside of bounds of the model's vertices
+            glm::u16vec3 Position;
+            uint16_t LightmapPage;
+            /// Unsigned normalized texture coordinates inside of UV bounds of the model
+            glm::u16vec2 UV;
+            /// Lightmap texel position in 1/`LightmapSubTexels` of a texel
+            glm::u16vec2 LightTexel;
+            /// Signed normalized, `w` is unused
+            glm::i8vec4 Normal;
+            /// Signed normalized, `w` is -127 or 127
+            glm::i8vec4 Tangent;
+        };
+        static_assert(sizeof(PackedVertex) == 24);
+        /// Lightmap coordinates are kept with this precision (texel centres are at 1/2), fits pages up to 8192 texels
+        static const uint32_t LightmapSubTexels = 8;
+
+        /// Decoded value = `Offset + packed * Scale` (component-wise)
+        struct VertexQuantization
+        {
+            glm::vec3 PositionOffset;
+            glm::vec3 PositionScale;
+            glm::vec2 UVOffset;
+            glm::vec2 UVScale;
+            /// Lightmap coordinates do not have an offset
+            glm::vec2 LightScale;
+        };
+        /// Bounds of positions and texture coordinates of the model's vertices and size of lightmap pages
+        [[nodiscard]] VertexQuantization GetVertexQuantization(const Model& model) const;
+
+        /// Values outside of the quantization range are clamped
+        [[nodiscard]] static PackedVertex EncodeVertex(const Vertex& vertex, const VertexQuantization& quantization) noexcept;
+        [[nodiscard]] static Vertex DecodeVertex(const PackedVertex& vertex, const VertexQuantization& quantization) noexcept;
+        /// Vertices of the model (`GetModelVertices`) in the packed format, model indices address them the same way
+        [[nodiscard]] std::vector<PackedVertex> GetPackedVertices(const Model& model, const VertexQuantization& quantization) const;
 
     public:
         /// Wavefront OBJ
         /// Text-based model format.
-        void ExportFlatObj(const std::filesystem::path& filename, const std::filesystem::path& mtlFilename = {}) const;
+        /// Text is formatted by `threadCount` threads (0 = number of CPU threads) and written at once.
+        void ExportFlatObj(const std::filesystem::path& filename, const std::filesystem::path& mtlFilename = {}, std::size_t threadCount = 0) const;
+        /// Wavefront OBJ of one brush model in its local space, transform and entity are written into comments.
+        void ExportModelObj(const ModelMesh& mesh, const std::filesystem::path& filename, const std::filesystem::path& mtlFilename = {}) const;
         /// Wavefront OBJ - Materials
         /// Materials for OBJ.
         void ExportMtl(const std::filesystem::path& filename, const std::filesystem::path& texturePath = ".", const std::string& textureExtension = ".png") const;
         void ExportTextures(const std::filesystem::path& directory, const std::string& textureExtension = ".png", bool dummyForMissing = false) const;
+        /// Binary glTF 2.0
+        /// Vertices are interleaved (position, texture UV as `TEXCOORD_0`, lightmap UV as `TEXCOORD_1`, normal and tangent), every model is a node
+        /// with a primitive per texture (and lightmap page). Axes are the same as in OBJ, triangles are counter-clockwise.
+        /// Textures packed in BSP are embedded as PNG when `embedTextures`, others are referenced as `texturePath/<name>.png`.
+        /// First layer of every lightmap page is embedded, materials point to it in `extras.lightmapTexture`.
+        /// `quantize` stores `PackedVertex` (KHR_mesh_quantization), nodes and texture transforms (KHR_texture_transform) restore the ranges.
+        void ExportGlb(const std::filesystem::path& filename, bool embedTextures = true, const std::filesystem::path& texturePath = ".", bool quantize = false, std::size_t threadCount = 0) const;
+
+        /// Decodes one mip-map level of a texture packed in BSP, empty if the texture is external (WAD)
+        [[nodiscard]] inline std::vector<glm::u8vec4> GetTextureRgba(std::size_t textureId, std::size_t level = 0) const
+        {
+            R_ASSERT(textureId < Textures.size(), "Texture index is outside of bounds");
+            if(!Textures[textureId].HasData())
+                return {};
+            return Bsp->GetTextureRgba(Textures[textureId], level);
+        }
+
+    private:
+        static void ExportObjHeader(std::ostream& out, const std::filesystem::path& mtlFilename);
+        static void ExportObjVertices(std::string& text, std::span<const Vertex> vertices);
+        static void ExportObjModelName(std::string& text, std::size_t modelIndex);
+        /// `firstIndex` = OBJ index of the first vertex of the model
+        void ExportObjFaces(std::string& text, const Model& model, const Model::TextureRange& range, uint32_t firstIndex) const;
 
     public:
         inline static float GetLightStyle_Char(char c)
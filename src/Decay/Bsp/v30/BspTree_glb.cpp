@@ -0,0 +1,598 @@
+#include "BspTree.hpp"
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+
+namespace Decay::Bsp::v30
+{
+    namespace
+    {
+        /// glTF constants
+        namespace Gltf
+        {
+            static const uint32_t Magic = 0x46546C67u; // "glTF"
+            static const uint32_t Version = 2;
+            static const uint32_t ChunkJson = 0x4E4F534Au; // "JSON"
+            static const uint32_t ChunkBin = 0x004E4942u; // "BIN\0"
+
+            static const int ArrayBuffer = 34962;
+            static const int ElementArrayBuffer = 34963;
+
+            static const int Byte = 5120;
+            static const int UnsignedShort = 5123;
+            static const int UnsignedInt = 5125;
+            static const int Float = 5126;
+
+            static const int Linear = 9729;
+            static const int ClampToEdge = 33071;
+        }
+
+        constexpr float MaxPackedValue = std::numeric_limits<uint16_t>::max();
+
+        /// Vertex as it is stored in the binary chunk
+        struct GlbVertex
+        {
+            glm::vec3 Position;
+            glm::vec2 UV;
+            glm::vec2 LightUV;
+            glm::vec3 Normal;
+            glm::vec4 Tangent;
+        };
+        static_assert(sizeof(GlbVertex) == 56);
+
+        /// Same axes as `ExportFlatObj`
+        [[nodiscard]] inline glm::vec3 ToGltfAxes(const glm::vec3& v) noexcept
+        {
+            return { -v.x, v.z, v.y };
+        }
+
+        /// Quantized position is `65535 - x, z, y` so the node transform does not need negative scale (which would flip winding)
+        [[nodiscard]] inline glm::u16vec3 SwizzlePackedPosition(const glm::u16vec3& position) noexcept
+        {
+            return { static_cast<uint16_t>(std::numeric_limits<uint16_t>::max() - position.x), position.z, position.y };
+        }
+        /// Scale of the node with quantized mesh in glTF axes, flat dimension keeps scale 1 so the transform stays invertible
+        [[nodiscard]] inline glm::vec3 PackedNodeScale(const BspTree::VertexQuantization& quantization) noexcept
+        {
+            glm::vec3 scale = { quantization.PositionScale.x, quantization.PositionScale.z, quantization.PositionScale.y };
+            for(int i = 0; i < 3; i++)
+            {
+                if(scale[i] == 0)
+                    scale[i] = 1;
+            }
+            return scale;
+        }
+        /// Normals are transformed by inverse transpose of the node transform and tangents by the transform itself,
+        /// so they are stored pre-scaled to come out right after non-uniform scale of the node
+        [[nodiscard]] inline glm::i8vec4 PackDirection(const glm::vec3& direction, float w) noexcept
+        {
+            const glm::vec3 unit = glm::dot(direction, direction) > 0 ? glm::normalize(direction) : direction;
+            glm::i8vec4 packed;
+            for(int i = 0; i < 3; i++)
+                packed[i] = static_cast<int8_t>(std::round(unit[i] * 127.0f));
+            packed.w = static_cast<int8_t>(std::round(w * 127.0f));
+            return packed;
+        }
+
+        /// Appends JSON text, only what the exporter needs
+        class JsonWriter
+        {
+        public:
+            std::string Text;
+
+        public:
+            inline JsonWriter& operator<<(std::string_view str)
+            {
+                Text.append(str);
+                return *this;
+            }
+            inline JsonWriter& operator<<(char c)
+            {
+                Text.push_back(c);
+                return *this;
+            }
+            inline JsonWriter& operator<<(std::size_t value)
+            {
+                char buffer[24];
+                const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+                Text.append(buffer, result.ptr);
+                return *this;
+            }
+            inline JsonWriter& operator<<(int value) { return *this << static_cast<std::size_t>(value); }
+            /// Shortest text which is read back as the same float
+            inline JsonWriter& operator<<(float value)
+            {
+                char buffer[32];
+                const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+                Text.append(buffer, result.ptr);
+                return *this;
+            }
+
+            /// Quoted and escaped
+            void String(std::string_view str)
+            {
+                static const char* Hex = "0123456789abcdef";
+
+                Text.push_back('"');
+                for(char c : str)
+                {
+                    if(c == '"' || c == '\\')
+                    {
+                        Text.push_back('\\');
+                        Text.push_back(c);
+                    }
+                    else if(static_cast<unsigned char>(c) < 0x20)
+                    {
+                        Text.append("\\u00");
+                        Text.push_back(Hex[(c >> 4) & 0xF]);
+                        Text.push_back(Hex[c & 0xF]);
+                    }
+                    else
+                        Text.push_back(c);
+                }
+                Text.push_back('"');
+            }
+            /// Comma before every item except the first one
+            inline void Separator(bool& first)
+            {
+                if(!first)
+                    Text.push_back(',');
+                first = false;
+            }
+        };
+
+        /// Relative URI of a file, characters which are not allowed in URI are percent-encoded (texture names contain `{`, `!`...)
+        std::string FileUri(const std::filesystem::path& path)
+        {
+            static const char* Hex = "0123456789ABCDEF";
+
+            std::string uri;
+            for(char c : path.generic_string())
+            {
+                if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~' || c == '/')
+                    uri.push_back(c);
+                else
+                {
+                    uri.push_back('%');
+                    uri.push_back(Hex[(static_cast<unsigned char>(c) >> 4) & 0xF]);
+                    uri.push_back(Hex[static_cast<unsigned char>(c) & 0xF]);
+                }
+            }
+            return uri;
+        }
+
+        std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, int components, const void* data)
+        {
+            std::vector<uint8_t> png;
+            const int result = stbi_write_png_to_func(
+                [](void* context, void* bytes, int size)
+                {
+                    auto& out = *static_cast<std::vector<uint8_t>*>(context);
+                    out.insert(out.end(), static_cast<const uint8_t*>(bytes), static_cast<const uint8_t*>(bytes) + size);
+                },
+                &png,
+                static_cast<int>(width), static_cast<int>(height), components,
+                data,
+                static_cast<int>(width) * components
+            );
+            if(result == 0)
+                throw std::runtime_error("Failed to encode PNG");
+            return png;
+        }
+    }
+
+    void BspTree::ExportGlb(const std::filesystem::path& filename, bool embedTextures, const std::filesystem::path& texturePath, bool quantize, std::size_t threadCount) const
+    {
+        // Binary chunk, every buffer view starts at multiple of 4
+        std::vector<uint8_t> bin;
+        struct BufferView
+        {
+            std::size_t Offset;
+            std::size_t Length;
+            std::size_t Stride;
+            int Target;
+        };
+        std::vector<BufferView> bufferViews;
+        const auto addBufferView = [&bin, &bufferViews](const void* data, std::size_t length, std::size_t stride, int target)
+        {
+            bin.resize((bin.size() + 3) & ~static_cast<std::size_t>(3), 0);
+            bufferViews.push_back({ bin.size(), length, stride, target });
+            bin.insert(bin.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + length);
+            return bufferViews.size() - 1;
+        };
+
+        // Same axes as `ExportFlatObj` (Y up), UVs are already top-down like glTF expects
+        std::vector<GlbVertex> vertices(quantize ? 0 : Vertices.size());
+        for(std::size_t i = 0; i < vertices.size(); i++)
+        {
+            const Vertex& vertex = Vertices[i];
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+            #warning Exporting GLB will use ST texture coordinates instead of UV
+            const glm::vec2 uv = vertex.ST;
+#else
+            const glm::vec2 uv = vertex.UV;
+#endif
+#ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
+            #warning Exporting GLB will use ST lightmap coordinates instead of UV
+            const glm::vec2 lightUv = vertex.LightST;
+#else
+            const glm::vec2 lightUv = vertex.LightUV;
+#endif
+            const glm::vec3 tangent = ToGltfAxes(glm::vec3(vertex.Tangent.x, vertex.Tangent.y, vertex.Tangent.z));
+            vertices[i] = GlbVertex{
+                ToGltfAxes(vertex.Position), uv, lightUv,
+                ToGltfAxes(vertex.Normal), glm::vec4(tangent.x, tangent.y, tangent.z, vertex.Tangent.w)
+            };
+        }
+        std::size_t vertexView = 0;
+        if(!vertices.empty())
+            vertexView = addBufferView(vertices.data(), vertices.size() * sizeof(GlbVertex), sizeof(GlbVertex), Gltf::ArrayBuffer);
+
+        // Quantized vertices (KHR_mesh_quantization) are in range of their model, node transform and texture transforms restore them
+        std::vector<VertexQuantization> quantizations;
+        std::vector<PackedVertex> packed(quantize ? Vertices.size() : 0);
+        if(quantize)
+        {
+            quantizations.reserve(Models.size());
+            for(const auto& model : Models)
+            {
+                quantizations.emplace_back(GetVertexQuantization(*model));
+                const glm::vec3 scale = PackedNodeScale(quantizations.back());
+
+                const std::vector<PackedVertex> modelVertices = GetPackedVertices(*model, quantizations.back());
+                for(std::size_t i = 0; i < modelVertices.size(); i++)
+                {
+                    const Vertex& vertex = Vertices[model->BaseVertex + i];
+                    PackedVertex& out = packed[model->BaseVertex + i];
+                    out = modelVertices[i];
+                    out.Position = SwizzlePackedPosition(modelVertices[i].Position);
+                    out.Normal = PackDirection(ToGltfAxes(vertex.Normal) * scale, 0);
+                    out.Tangent = PackDirection(ToGltfAxes(glm::vec3(vertex.Tangent.x, vertex.Tangent.y, vertex.Tangent.z)) / scale, vertex.Tangent.w < 0 ? -1.0f : 1.0f);
+                }
+            }
+            if(!packed.empty())
+                vertexView = addBufferView(packed.data(), packed.size() * sizeof(PackedVertex), sizeof(PackedVertex), Gltf::ArrayBuffer);
+        }
+
+        // Faces are clockwise, glTF front faces are counter-clockwise
+        std::vector<std::size_t> indexViews(Models.size(), 0);
+        for(std::size_t mi = 0; mi < Models.size(); mi++)
+        {
+            const IndexBuffer& indices = Models[mi]->Indices;
+            if(indices.empty())
+                continue;
+
+            std::vector<uint8_t> flipped(indices.size() * indices.GetIndexSize());
+            std::memcpy(flipped.data(), indices.data(), flipped.size());
+            for(std::size_t i = 0; i < indices.size(); i += 3)
+            {
+                const std::size_t size = indices.GetIndexSize();
+                std::swap_ranges(flipped.data() + (i + 1) * size, flipped.data() + (i + 2) * size, flipped.data() + (i + 2) * size);
+            }
+            indexViews[mi] = addBufferView(flipped.data(), flipped.size(), 0, Gltf::ElementArrayBuffer);
+        }
+
+        // Images - textures (referenced when they are not in BSP or `embedTextures` is off) and first layer of lightmap pages
+        std::vector<std::vector<uint8_t>> pngs(Textures.size() + Lightmaps.size());
+        ParallelFor(pngs.size(), threadCount, [&](std::size_t begin, std::size_t end)
+        {
+            for(std::size_t i = begin; i < end; i++)
+            {
+                if(i < Textures.size())
+                {
+                    if(!embedTextures || !Textures[i].HasData())
+                        continue;
+
+                    const std::vector<glm::u8vec4> rgba = GetTextureRgba(i);
+                    pngs[i] = EncodePng(Textures[i].Width, Textures[i].Height, 4, rgba.data());
+                }
+                else
+                {
+                    const Lightmap& lightmap = Lightmaps[i - Textures.size()];
+                    pngs[i] = EncodePng(lightmap.Width, lightmap.Height, 3, lightmap.Layers[0].data());
+                }
+            }
+        });
+
+        JsonWriter json;
+        json << R"({"asset":{"version":"2.0","generator":"Decay Library"},"scene":0)";
+        if(quantize)
+        {
+            json << R"(,"extensionsUsed":["KHR_mesh_quantization","KHR_texture_transform"])"
+                 << R"(,"extensionsRequired":["KHR_mesh_quantization","KHR_texture_transform"])";
+        }
+
+        // Images, textures and samplers
+        {
+            json << R"(,"samplers":[{},{"magFilter":)" << Gltf::Linear << R"(,"minFilter":)" << Gltf::Linear
+                 << R"(,"wrapS":)" << Gltf::ClampToEdge << R"(,"wrapT":)" << Gltf::ClampToEdge << "}]";
+
+            bool first = true;
+            json << R"(,"images":[)";
+            for(std::size_t i = 0; i < pngs.size(); i++)
+            {
+                json.Separator(first);
+                if(!pngs[i].empty())
+                {
+                    json << R"({"mimeType":"image/png","bufferView":)" << addBufferView(pngs[i].data(), pngs[i].size(), 0, 0) << '}';
+                    continue;
+                }
+
+                const std::string file = Textures[i].Name + ".png";
+                json << R"({"uri":)";
+                json.String(FileUri(texturePath == "." ? std::filesystem::path(file) : texturePath / file));
+                json << '}';
+            }
+            json << ']';
+
+            // Texture `i` uses image `i`
+            first = true;
+            json << R"(,"textures":[)";
+            for(std::size_t i = 0; i < pngs.size(); i++)
+            {
+                json.Separator(first);
+                json << R"({"source":)" << i << R"(,"sampler":)" << (i < Textures.size() ? 0 : 1) << '}';
+            }
+            json << ']';
+        }
+
+        // Primitive for every continuous run of triangles with the same texture and lightmap page,
+        // quantized texture coordinates differ between models so every model has its own materials then
+        struct Material
+        {
+            uint16_t TextureId;
+            uint32_t Page;
+            std::size_t Model;
+
+            [[nodiscard]] inline bool operator<(const Material& other) const noexcept
+            {
+                return std::tie(TextureId, Page, Model) < std::tie(other.TextureId, other.Page, other.Model);
+            }
+        };
+        struct Primitive
+        {
+            std::size_t Offset;
+            std::size_t Count;
+            std::size_t Material;
+        };
+        std::vector<std::vector<Primitive>> primitives(Models.size());
+        std::map<Material, std::size_t> materialLookup;
+        std::vector<Material> materials;
+        for(std::size_t mi = 0; mi < Models.size(); mi++)
+        {
+            const Model& model = *Models[mi];
+            for(const auto& range : model.TextureRanges)
+            {
+                for(std::size_t ii = range.Offset; ii < range.Offset + range.Count; ii += 3)
+                {
+                    const Material key = { range.TextureId, Vertices[model.BaseVertex + model.Indices[ii]].LightmapPage, quantize ? mi : 0 };
+                    auto [it, inserted] = materialLookup.emplace(key, materials.size());
+                    if(inserted)
+                        materials.push_back(key);
+
+                    if(ii != range.Offset && primitives[mi].back().Material == it->second)
+                        primitives[mi].back().Count += 3;
+                    else
+                        primitives[mi].push_back({ ii, 3, it->second });
+                }
+            }
+        }
+
+        // Materials - lightmap is not part of glTF, it is in `extras` and uses the second UV set
+        if(!materials.empty())
+        {
+            bool first = true;
+            json << R"(,"materials":[)";
+            for(const Material& material : materials)
+            {
+                const std::string& name = Textures[material.TextureId].Name;
+
+                json.Separator(first);
+                json << R"({"name":)";
+                json.String(Lightmaps.size() > 1 ? name + "_" + std::to_string(material.Page) : name);
+                json << R"(,"pbrMetallicRoughness":{"baseColorTexture":{"index":)" << static_cast<std::size_t>(material.TextureId);
+                if(quantize)
+                {
+                    // Normalized texture coordinates are 0..1 over the range of the model
+                    const VertexQuantization& quantization = quantizations[material.Model];
+                    const glm::vec2 scale = quantization.UVScale * MaxPackedValue;
+                    json << R"(,"extensions":{"KHR_texture_transform":{"offset":[)" << quantization.UVOffset.x << ',' << quantization.UVOffset.y
+                         << R"(],"scale":[)" << scale.x << ',' << scale.y << "]}}";
+                }
+                json << R"(},"metallicFactor":0,"roughnessFactor":1})";
+                if(!name.empty() && name[0] == '{') // Palette index 255 is transparent
+                    json << R"(,"alphaMode":"MASK","alphaCutoff":0.5)";
+                json << R"(,"extras":{"lightmapTexture":{"index":)" << Textures.size() + material.Page << R"(,"texCoord":1)";
+                if(quantize)
+                {
+                    const glm::vec2 scale = quantizations[material.Model].LightScale * MaxPackedValue;
+                    json << R"(,"extensions":{"KHR_texture_transform":{"scale":[)" << scale.x << ',' << scale.y << "]}}";
+                }
+                json << "}}}";
+            }
+            json << ']';
+        }
+
+        // Accessors and meshes, models without triangles do not have a mesh
+        std::vector<std::size_t> meshes(Models.size(), 0);
+        {
+            JsonWriter accessors;
+            JsonWriter meshesJson;
+            bool firstAccessor = true;
+            bool firstMesh = true;
+            std::size_t accessorCount = 0;
+            std::size_t meshCount = 0;
+
+            for(std::size_t mi = 0; mi < Models.size(); mi++)
+            {
+                const Model& model = *Models[mi];
+                if(primitives[mi].empty())
+                    continue;
+
+                glm::vec3 min, max;
+                const auto position = [&](std::size_t i) { return quantize ? glm::vec3(packed[i].Position) : vertices[i].Position; };
+                min = max = position(model.BaseVertex);
+                for(std::size_t i = model.BaseVertex; i < model.BaseVertex + model.VertexCount; i++)
+                {
+                    min = glm::min(min, position(i));
+                    max = glm::max(max, position(i));
+                }
+
+                // Quantized positions are integers, texture coordinates are normalized
+                const std::size_t vertexOffset = model.BaseVertex * (quantize ? sizeof(PackedVertex) : sizeof(GlbVertex));
+                const int componentType = quantize ? Gltf::UnsignedShort : Gltf::Float;
+                const std::string_view normalized = quantize ? R"(,"normalized":true)" : "";
+
+                const std::size_t positionAccessor = accessorCount++;
+                accessors.Separator(firstAccessor);
+                accessors << R"({"bufferView":)" << vertexView << R"(,"byteOffset":)" << vertexOffset + (quantize ? offsetof(PackedVertex, Position) : offsetof(GlbVertex, Position))
+                          << R"(,"componentType":)" << componentType << R"(,"count":)" << static_cast<std::size_t>(model.VertexCount)
+                          << R"(,"type":"VEC3","min":[)" << min.x << ',' << min.y << ',' << min.z
+                          << R"(],"max":[)" << max.x << ',' << max.y << ',' << max.z << "]}";
+                const std::size_t uvAccessor = accessorCount++;
+                accessors << R"(,{"bufferView":)" << vertexView << R"(,"byteOffset":)" << vertexOffset + (quantize ? offsetof(PackedVertex, UV) : offsetof(GlbVertex, UV))
+                          << R"(,"componentType":)" << componentType << normalized << R"(,"count":)" << static_cast<std::size_t>(model.VertexCount) << R"(,"type":"VEC2"})";
+                const std::size_t lightUvAccessor = accessorCount++;
+                accessors << R"(,{"bufferView":)" << vertexView << R"(,"byteOffset":)" << vertexOffset + (quantize ? offsetof(PackedVertex, LightTexel) : offsetof(GlbVertex, LightUV))
+                          << R"(,"componentType":)" << componentType << normalized << R"(,"count":)" << static_cast<std::size_t>(model.VertexCount) << R"(,"type":"VEC2"})";
+                const int directionType = quantize ? Gltf::Byte : Gltf::Float;
+                const std::size_t normalAccessor = accessorCount++;
+                accessors << R"(,{"bufferView":)" << vertexView << R"(,"byteOffset":)" << vertexOffset + (quantize ? offsetof(PackedVertex, Normal) : offsetof(GlbVertex, Normal))
+                          << R"(,"componentType":)" << directionType << normalized << R"(,"count":)" << static_cast<std::size_t>(model.VertexCount) << R"(,"type":"VEC3"})";
+                const std::size_t tangentAccessor = accessorCount++;
+                accessors << R"(,{"bufferView":)" << vertexView << R"(,"byteOffset":)" << vertexOffset + (quantize ? offsetof(PackedVertex, Tangent) : offsetof(GlbVertex, Tangent))
+                          << R"(,"componentType":)" << directionType << normalized << R"(,"count":)" << static_cast<std::size_t>(model.VertexCount) << R"(,"type":"VEC4"})";
+
+                meshesJson.Separator(firstMesh);
+                meshesJson << R"({"name":"Model_)" << mi << R"(","primitives":[)";
+                bool firstPrimitive = true;
+                for(const Primitive& primitive : primitives[mi])
+                {
+                    accessors << R"(,{"bufferView":)" << indexViews[mi] << R"(,"byteOffset":)" << primitive.Offset * model.Indices.GetIndexSize()
+                              << R"(,"componentType":)" << (model.Indices.IsWide() ? Gltf::UnsignedInt : Gltf::UnsignedShort)
+                              << R"(,"count":)" << primitive.Count << R"(,"type":"SCALAR"})";
+
+                    meshesJson.Separator(firstPrimitive);
+                    meshesJson << R"({"attributes":{"POSITION":)" << positionAccessor << R"(,"TEXCOORD_0":)" << uvAccessor << R"(,"TEXCOORD_1":)" << lightUvAccessor
+                               << R"(,"NORMAL":)" << normalAccessor << R"(,"TANGENT":)" << tangentAccessor
+                               << R"(},"indices":)" << accessorCount++ << R"(,"material":)" << primitive.Material << '}';
+                }
+                meshesJson << "]}";
+
+                meshes[mi] = meshCount++;
+            }
+
+            // glTF does not allow empty arrays
+            if(meshCount != 0)
+            {
+                json << R"(,"accessors":[)" << accessors.Text << ']';
+                json << R"(,"meshes":[)" << meshesJson.Text << ']';
+            }
+        }
+
+        // Nodes - one per model in world space, brush models carry key-values of their entity
+        {
+            bool first = true;
+            json << R"(,"nodes":[)";
+            for(std::size_t mi = 0; mi < Models.size(); mi++)
+            {
+                json.Separator(first);
+                json << R"({"name":"Model_)" << mi << '"';
+                if(!primitives[mi].empty())
+                {
+                    json << R"(,"mesh":)" << meshes[mi];
+                    if(quantize)
+                    {
+                        // Inverse of `SwizzlePackedPosition`
+                        const glm::vec3 scale = PackedNodeScale(quantizations[mi]);
+                        const glm::vec3& offset = quantizations[mi].PositionOffset;
+                        json << R"(,"translation":[)" << -offset.x - scale.x * MaxPackedValue << ',' << offset.z << ',' << offset.y
+                             << R"(],"scale":[)" << scale.x << ',' << scale.y << ',' << scale.z << ']';
+                    }
+                }
+
+                const std::size_t entityIndex = mi == 0 ? BspEntities::NoEntity : Entities.FindModelEntity(static_cast<int>(mi));
+                if(entityIndex != BspEntities::NoEntity)
+                {
+                    bool firstKey = true;
+                    json << R"(,"extras":{)";
+                    for(const auto& [key, value] : Entities[entityIndex])
+                    {
+                        json.Separator(firstKey);
+                        json.String(key);
+                        json << ':';
+                        json.String(value);
+                    }
+                    json << '}';
+                }
+                json << '}';
+            }
+            json << ']';
+
+            first = true;
+            json << R"(,"scenes":[{"nodes":[)";
+            for(std::size_t mi = 0; mi < Models.size(); mi++)
+            {
+                json.Separator(first);
+                json << mi;
+            }
+            json << "]}]";
+        }
+
+        // Buffer views (known only after all images were added)
+        if(!bufferViews.empty())
+        {
+            bool first = true;
+            json << R"(,"bufferViews":[)";
+            for(const BufferView& view : bufferViews)
+            {
+                json.Separator(first);
+                json << R"({"buffer":0,"byteOffset":)" << view.Offset << R"(,"byteLength":)" << view.Length;
+                if(view.Stride != 0)
+                    json << R"(,"byteStride":)" << view.Stride;
+                if(view.Target != 0)
+                    json << R"(,"target":)" << view.Target;
+                json << '}';
+            }
+            json << ']';
+        }
+
+        bin.resize((bin.size() + 3) & ~static_cast<std::size_t>(3), 0);
+        if(!bin.empty())
+            json << R"(,"buffers":[{"byteLength":)" << bin.size() << "}]";
+        json << '}';
+
+        // JSON chunk is padded by spaces
+        json.Text.resize((json.Text.size() + 3) & ~static_cast<std::size_t>(3), ' ');
+
+        const std::size_t totalLength = 12 + 8 + json.Text.size() + (bin.empty() ? 0 : 8 + bin.size());
+        R_ASSERT(totalLength <= std::numeric_limits<uint32_t>::max(), "GLB is too big");
+
+        std::ofstream out(filename, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        const auto writeUint = [&out](std::size_t value)
+        {
+            const auto value32 = static_cast<uint32_t>(value);
+            out.write(reinterpret_cast<const char*>(&value32), sizeof(value32));
+        };
+
+        writeUint(Gltf::Magic);
+        writeUint(Gltf::Version);
+        writeUint(totalLength);
+
+        writeUint(json.Text.size());
+        writeUint(Gltf::ChunkJson);
+        out.write(json.Text.data(), static_cast<std::streamsize>(json.Text.size()));
+
+        if(!bin.empty())
+        {
+            writeUint(bin.size());
+            writeUint(Gltf::ChunkBin);
+            out.write(reinterpret_cast<const char*>(bin.data()), static_cast<std::streamsize>(bin.size()));
+        }
+
+        if(!out.good())
+            throw std::runtime_error("Failed to write GLB file");
+    }
+}
@@ -0,0 +1,278 @@
+#include "BspTree.hpp"
+
+#include <cmath>
+#include <numeric>
+
+namespace Decay::Bsp::v30
+{
+    namespace
+    {
+        /// Triangle order of one texture range.
+        /// Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak 2007)
+        /// - fans around a vertex and continues with the vertex which stays in the cache the longest.
+        /// Runs between cache flushes (dead ends) are clusters, they are ordered by the view-independent metric from the same paper.
+        class RangeOptimizer
+        {
+        public:
+            RangeOptimizer(const std::vector<uint32_t>& indices, std::span<const BspTree::Vertex> vertices, uint32_t cacheSize)
+              : m_Indices(indices), m_Vertices(vertices), m_CacheSize(cacheSize)
+            {
+                // Local vertices of the range, sorted
+                m_Local = m_Indices;
+                std::sort(m_Local.begin(), m_Local.end());
+                m_Local.erase(std::unique(m_Local.begin(), m_Local.end()), m_Local.end());
+
+                m_Corners.resize(m_Indices.size());
+                for(std::size_t i = 0; i < m_Indices.size(); i++)
+                    m_Corners[i] = static_cast<uint32_t>(std::lower_bound(m_Local.begin(), m_Local.end(), m_Indices[i]) - m_Local.begin());
+
+                // Triangles of every vertex (CSR), a degenerate triangle is there once per its corner
+                m_AdjacencyOffsets.assign(m_Local.size() + 1, 0);
+                for(uint32_t corner : m_Corners)
+                    m_AdjacencyOffsets[corner + 1]++;
+                std::partial_sum(m_AdjacencyOffsets.begin(), m_AdjacencyOffsets.end(), m_AdjacencyOffsets.begin());
+
+                m_Adjacency.resize(m_Corners.size());
+                std::vector<uint32_t> fill(m_AdjacencyOffsets.begin(), m_AdjacencyOffsets.end() - 1);
+                for(std::size_t i = 0; i < m_Corners.size(); i++)
+                    m_Adjacency[fill[m_Corners[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+        private:
+            const std::vector<uint32_t>& m_Indices;
+            std::span<const BspTree::Vertex> m_Vertices;
+            const uint32_t m_CacheSize;
+
+            std::vector<uint32_t> m_Local;
+            /// `m_Indices` as indices of `m_Local`
+            std::vector<uint32_t> m_Corners;
+            std::vector<uint32_t> m_AdjacencyOffsets;
+            std::vector<uint32_t> m_Adjacency;
+
+        public:
+            /// New order of triangles (indices of triangles of the range)
+            [[nodiscard]] std::vector<uint32_t> Optimize() const
+            {
+                const std::size_t triangleCount = m_Corners.size() / 3;
+
+                std::vector<uint32_t> live(m_Local.size());
+                for(std::size_t v = 0; v < m_Local.size(); v++)
+                    live[v] = m_AdjacencyOffsets[v + 1] - m_AdjacencyOffsets[v];
+                std::vector<uint32_t> cacheTime(m_Local.size(), 0);
+                std::vector<bool> emitted(triangleCount, false);
+
+                std::vector<uint32_t> deadEnd;
+                std::vector<uint32_t> candidates;
+
+                std::vector<uint32_t> order;
+                order.reserve(triangleCount);
+                std::vector<std::size_t> clusterStarts;
+
+                uint32_t time = m_CacheSize + 1;
+                std::size_t cursor = 0;
+                int64_t fanning = m_Local.empty() ? -1 : 0;
+                bool flushed = true;
+                while(fanning >= 0)
+                {
+                    if(flushed)
+                        clusterStarts.emplace_back(order.size());
+
+                    candidates.clear();
+                    for(uint32_t a = m_AdjacencyOffsets[fanning]; a < m_AdjacencyOffsets[fanning + 1]; a++)
+                    {
+                        const uint32_t triangle = m_Adjacency[a];
+                        if(emitted[triangle])
+                            continue;
+                        emitted[triangle] = true;
+                        order.emplace_back(triangle);
+
+                        for(std::size_t c = 0; c < 3; c++)
+                        {
+                            const uint32_t v = m_Corners[triangle * 3 + c];
+                            deadEnd.emplace_back(v);
+                            candidates.emplace_back(v);
+                            live[v]--;
+                            if(time - cacheTime[v] > m_CacheSize)
+                                cacheTime[v] = time++;
+                        }
+                    }
+
+                    // Vertex that stays in the cache after all its remaining triangles are emitted, the oldest one wins
+                    int64_t next = -1;
+                    int64_t bestPriority = -1;
+                    for(uint32_t v : candidates)
+                    {
+                        if(live[v] == 0)
+                            continue;
+
+                        int64_t priority = 0;
+                        if(time - cacheTime[v] + 2 * live[v] <= m_CacheSize)
+                            priority = time - cacheTime[v];
+                        if(priority > bestPriority)
+                        {
+                            bestPriority = priority;
+                            next = v;
+                        }
+                    }
+
+                    flushed = next < 0;
+                    if(flushed)
+                        next = SkipDeadEnd(live, deadEnd, cursor);
+                    fanning = next;
+                }
+                D_ASSERT(order.size() == triangleCount, "Tipsify did not emit every triangle");
+
+                return SortClusters(order, clusterStarts);
+            }
+
+        private:
+            /// Recently used vertex with triangles left, otherwise next one in input order, -1 = done
+            [[nodiscard]] static int64_t SkipDeadEnd(const std::vector<uint32_t>& live, std::vector<uint32_t>& deadEnd, std::size_t& cursor)
+            {
+                while(!deadEnd.empty())
+                {
+                    const uint32_t v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if(live[v] > 0)
+                        return v;
+                }
+                for(; cursor < live.size(); cursor++)
+                    if(live[cursor] > 0)
+                        return static_cast<int64_t>(cursor);
+                return -1;
+            }
+
+            /// Clusters facing away from the centre of the range go first, they are the most likely to hide the others
+            [[nodiscard]] std::vector<uint32_t> SortClusters(const std::vector<uint32_t>& order, const std::vector<std::size_t>& clusterStarts) const
+            {
+                const auto position = [this](uint32_t triangle, std::size_t corner) { return m_Vertices[m_Indices[triangle * 3 + corner]].Position; };
+
+                glm::vec3 centre = {0, 0, 0};
+                for(uint32_t triangle : order)
+                    centre += position(triangle, 0) + position(triangle, 1) + position(triangle, 2);
+                centre /= static_cast<float>(std::max<std::size_t>(order.size() * 3, 1));
+
+                struct Cluster
+                {
+                    std::size_t Begin, End;
+                    float Metric;
+                };
+                std::vector<Cluster> clusters(clusterStarts.size());
+                for(std::size_t ci = 0; ci < clusterStarts.size(); ci++)
+                {
+                    Cluster& cluster = clusters[ci];
+                    cluster.Begin = clusterStarts[ci];
+                    cluster.End = ci + 1 < clusterStarts.size() ? clusterStarts[ci + 1] : order.size();
+
+                    // Area weighted, faces are clockwise so the cross product points to their back
+                    glm::vec3 normal = {0, 0, 0};
+                    glm::vec3 clusterCentre = {0, 0, 0};
+                    for(std::size_t i = cluster.Begin; i < cluster.End; i++)
+                    {
+                        const glm::vec3 p0 = position(order[i], 0);
+                        const glm::vec3 a = position(order[i], 1) - p0;
+                        const glm::vec3 b = position(order[i], 2) - p0;
+                        normal -= glm::vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+                        clusterCentre += p0 + position(order[i], 1) + position(order[i], 2);
+                    }
+                    clusterCentre /= static_cast<float>((cluster.End - cluster.Begin) * 3);
+
+                    const glm::vec3 offset = clusterCentre - centre;
+                    const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+                    cluster.Metric = length > 0 ? (offset.x * normal.x + offset.y * normal.y + offset.z * normal.z) / length : 0;
+                }
+                std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.Metric > b.Metric; });
+
+                std::vector<uint32_t> sorted;
+                sorted.reserve(order.size());
+                for(const Cluster& cluster : clusters)
+                    sorted.insert(sorted.end(), order.begin() + cluster.Begin, order.begin() + cluster.End);
+                return sorted;
+            }
+        };
+    }
+
+    void BspTree::OptimizeMeshes(uint32_t cacheSize, std::size_t threadCount)
+    {
+        R_ASSERT(cacheSize >= 3, "Vertex cache must hold at least one triangle");
+
+        // Every texture range is independent
+        struct RangeRef
+        {
+            std::size_t Model;
+            std::size_t Range;
+        };
+        std::vector<RangeRef> ranges;
+        for(std::size_t mi = 0; mi < Models.size(); mi++)
+            for(std::size_t ri = 0; ri < Models[mi]->TextureRanges.size(); ri++)
+                ranges.push_back({ mi, ri });
+
+        // [ model ] = indices and faces of triangles in new order
+        std::vector<std::vector<uint32_t>> modelIndices(Models.size());
+        std::vector<std::vector<uint32_t>> modelFaces(Models.size());
+        for(std::size_t mi = 0; mi < Models.size(); mi++)
+        {
+            modelIndices[mi].resize(Models[mi]->Indices.size());
+            modelFaces[mi].resize(Models[mi]->TriangleFaces.size());
+        }
+
+        ParallelFor(ranges.size(), threadCount, [&](std::size_t begin, std::size_t end)
+        {
+            std::vector<uint32_t> indices;
+            for(std::size_t i = begin; i < end; i++)
+            {
+                const Model& model = *Models[ranges[i].Model];
+                const Model::TextureRange& range = model.TextureRanges[ranges[i].Range];
+
+                indices.resize(range.Count);
+                for(std::size_t ii = 0; ii < range.Count; ii++)
+                    indices[ii] = model.Indices[range.Offset + ii];
+
+                const std::vector<uint32_t> order = RangeOptimizer(indices, GetModelVertices(model), cacheSize).Optimize();
+
+                std::vector<uint32_t>& outIndices = modelIndices[ranges[i].Model];
+                std::vector<uint32_t>& outFaces = modelFaces[ranges[i].Model];
+                for(std::size_t ti = 0; ti < order.size(); ti++)
+                {
+                    const std::size_t triangle = range.Offset / 3 + ti;
+                    outFaces[triangle] = model.TriangleFaces[range.Offset / 3 + order[ti]];
+                    for(std::size_t c = 0; c < 3; c++)
+                        outIndices[triangle * 3 + c] = indices[order[ti] * 3 + c];
+                }
+            }
+        });
+
+        // Vertices in order of first use, so vertex fetches go forward through memory
+        ParallelFor(Models.size(), threadCount, [&](std::size_t begin, std::size_t end)
+        {
+            static const uint32_t Unused = ~0u;
+
+            for(std::size_t mi = begin; mi < end; mi++)
+            {
+                Model& model = *Models[mi];
+                std::vector<uint32_t>& indices = modelIndices[mi];
+
+                std::vector<uint32_t> remap(model.VertexCount, Unused);
+                std::vector<Vertex> vertices;
+                vertices.reserve(model.VertexCount);
+                for(uint32_t& index : indices)
+                {
+                    if(remap[index] == Unused)
+                    {
+                        remap[index] = static_cast<uint32_t>(vertices.size());
+                        vertices.emplace_back(Vertices[model.BaseVertex + index]);
+                    }
+                    index = remap[index];
+                }
+                // Vertices without triangles stay at the end
+                for(uint32_t v = 0; v < model.VertexCount; v++)
+                    if(remap[v] == Unused)
+                        vertices.emplace_back(Vertices[model.BaseVertex + v]);
+
+                std::copy(vertices.begin(), vertices.end(), Vertices.begin() + model.BaseVertex);
+                model.Indices = IndexBuffer(indices, model.Indices.IsWide());
+                model.TriangleFaces = std::move(modelFaces[mi]);
+            }
+        });
+    }
+}
@@ -0,0 +1,166 @@
+#include "BspTree.hpp"
+
+#include <cmath>
+
+namespace Decay::Bsp::v30
+{
+    namespace
+    {
+        constexpr float MaxUnorm16 = 65535.0f;
+
+        /// Round to nearest, clamped into 16 bits
+        [[nodiscard]] inline uint16_t ToUint16(float value) noexcept
+        {
+            return static_cast<uint16_t>(std::clamp(std::round(value), 0.0f, MaxUnorm16));
+        }
+        /// Scale which maps `extent` onto the whole 16-bit range, 0 for flat dimension
+        [[nodiscard]] inline float RangeScale(float extent) noexcept
+        {
+            return extent > 0 ? extent / MaxUnorm16 : 0.0f;
+        }
+        [[nodiscard]] inline float Encode(float value, float offset, float scale) noexcept
+        {
+            return scale > 0 ? (value - offset) / scale : 0.0f;
+        }
+
+        constexpr float MaxSnorm8 = 127.0f;
+
+        /// -1 to 1 rounded to nearest
+        [[nodiscard]] inline int8_t ToSnorm8(float value) noexcept
+        {
+            return static_cast<int8_t>(std::round(std::clamp(value, -1.0f, 1.0f) * MaxSnorm8));
+        }
+        [[nodiscard]] inline float FromSnorm8(int8_t value) noexcept
+        {
+            return std::max(static_cast<float>(value) / MaxSnorm8, -1.0f);
+        }
+    }
+
+    BspTree::VertexQuantization BspTree::GetVertexQuantization(const Model& model) const
+    {
+        VertexQuantization quantization{};
+
+        // Bounds of the vertices themselves, bounding box stored in the file may be padded or wrong
+        const auto vertices = GetModelVertices(model);
+        if(!vertices.empty())
+        {
+            glm::vec3 positionMin = vertices[0].Position;
+            glm::vec3 positionMax = positionMin;
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+            glm::vec2 uvMin = vertices[0].ST;
+#else
+            glm::vec2 uvMin = vertices[0].UV;
+#endif
+            glm::vec2 uvMax = uvMin;
+            for(const Vertex& vertex : vertices)
+            {
+                positionMin = glm::min(positionMin, vertex.Position);
+                positionMax = glm::max(positionMax, vertex.Position);
+
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+                const glm::vec2& uv = vertex.ST;
+#else
+                const glm::vec2& uv = vertex.UV;
+#endif
+                // Texture coordinates repeat, only the range used by the model is stored
+                uvMin = glm::min(uvMin, uv);
+                uvMax = glm::max(uvMax, uv);
+            }
+
+            quantization.PositionOffset = positionMin;
+            for(int i = 0; i < 3; i++)
+                quantization.PositionScale[i] = RangeScale(positionMax[i] - positionMin[i]);
+
+            quantization.UVOffset = uvMin;
+            for(int i = 0; i < 2; i++)
+                quantization.UVScale[i] = RangeScale(uvMax[i] - uvMin[i]);
+        }
+
+        // All pages have the same size
+        const Lightmap& page = Lightmaps.front();
+        R_ASSERT(page.Width * LightmapSubTexels <= MaxUnorm16 + 1 && page.Height * LightmapSubTexels <= MaxUnorm16 + 1, "Lightmap page is too big for packed vertices");
+#ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
+        quantization.LightScale = glm::vec2(1.0f / LightmapSubTexels);
+#else
+        quantization.LightScale = {
+            1.0f / static_cast<float>(page.Width * LightmapSubTexels),
+            1.0f / static_cast<float>(page.Height * LightmapSubTexels)
+        };
+#endif
+
+        return quantization;
+    }
+
+    BspTree::PackedVertex BspTree::EncodeVertex(const Vertex& vertex, const VertexQuantization& quantization) noexcept
+    {
+        PackedVertex packed{};
+
+        for(int i = 0; i < 3; i++)
+            packed.Position[i] = ToUint16(Encode(vertex.Position[i], quantization.PositionOffset[i], quantization.PositionScale[i]));
+
+        D_ASSERT(vertex.LightmapPage <= std::numeric_limits<uint16_t>::max(), "Lightmap page does not fit into packed vertex");
+        packed.LightmapPage = static_cast<uint16_t>(vertex.LightmapPage);
+
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+        const glm::vec2& uv = vertex.ST;
+#else
+        const glm::vec2& uv = vertex.UV;
+#endif
+#ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
+        const glm::vec2& lightUv = vertex.LightST;
+#else
+        const glm::vec2& lightUv = vertex.LightUV;
+#endif
+        for(int i = 0; i < 2; i++)
+        {
+            packed.UV[i] = ToUint16(Encode(uv[i], quantization.UVOffset[i], quantization.UVScale[i]));
+            packed.LightTexel[i] = ToUint16(Encode(lightUv[i], 0, quantization.LightScale[i]));
+        }
+
+        for(int i = 0; i < 3; i++)
+        {
+            packed.Normal[i] = ToSnorm8(vertex.Normal[i]);
+            packed.Tangent[i] = ToSnorm8(vertex.Tangent[i]);
+        }
+        packed.Tangent.w = vertex.Tangent.w < 0 ? -127 : 127;
+
+        return packed;
+    }
+    BspTree::Vertex BspTree::DecodeVertex(const PackedVertex& packed, const VertexQuantization& quantization) noexcept
+    {
+        Vertex vertex{};
+
+        vertex.Position = quantization.PositionOffset + glm::vec3(packed.Position) * quantization.PositionScale;
+        vertex.LightmapPage = packed.LightmapPage;
+
+#ifdef DECAY_BSP_ST_INSTEAD_OF_UV
+        vertex.ST = quantization.UVOffset + glm::vec2(packed.UV) * quantization.UVScale;
+#else
+        vertex.UV = quantization.UVOffset + glm::vec2(packed.UV) * quantization.UVScale;
+#endif
+#ifdef DECAY_BSP_LIGHTMAP_ST_INSTEAD_OF_UV
+        vertex.LightST = glm::vec2(packed.LightTexel) * quantization.LightScale;
+#else
+        vertex.LightUV = glm::vec2(packed.LightTexel) * quantization.LightScale;
+#endif
+
+        // Rounding makes the vectors a bit shorter or longer
+        const glm::vec3 normal = { FromSnorm8(packed.Normal.x), FromSnorm8(packed.Normal.y), FromSnorm8(packed.Normal.z) };
+        const glm::vec3 tangent = { FromSnorm8(packed.Tangent.x), FromSnorm8(packed.Tangent.y), FromSnorm8(packed.Tangent.z) };
+        vertex.Normal = glm::dot(normal, normal) > 0 ? glm::normalize(normal) : normal;
+        const glm::vec3 unitTangent = glm::dot(tangent, tangent) > 0 ? glm::normalize(tangent) : tangent;
+        vertex.Tangent = glm::vec4(unitTangent.x, unitTangent.y, unitTangent.z, packed.Tangent.w < 0 ? -1.0f : 1.0f);
+
+        return vertex;
+    }
+
+    std::vector<BspTree::PackedVertex> BspTree::GetPackedVertices(const Model& model, const VertexQuantization& quantization) const
+    {
+        const auto vertices = GetModelVertices(model);
+
+        std::vector<PackedVertex> packed(vertices.size());
+        for(std::size_t i = 0; i < vertices.size(); i++)
+            packed[i] = EncodeVertex(vertices[i], quantization);
+        return packed;
+    }
+}
@@ -0,0 +1,149 @@
+#include "BspVisibility.hpp"
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+namespace Decay::Bsp::v30
+{
+    BspVisibility::BspVisibility(std::shared_ptr<BspFile> bsp, bool decompressAll)
+      : Bsp(std::move(bsp)),
+        LeafCount(Bsp->GetMainModel().VisLeafCount > 0 ? static_cast<std::size_t>(Bsp->GetMainModel().VisLeafCount) : 0),
+        RowWords((LeafCount + 63) / 64),
+        m_Rows(LeafCount * RowWords),
+        m_RowDecompressed(new std::atomic<bool>[LeafCount]())
+    {
+        R_ASSERT(LeafCount < Bsp->GetLeafCount(), "Main model has more visible leaves than there are leaves");
+
+        if(decompressAll)
+        {
+            for(std::size_t row = 0; row < LeafCount; row++)
+                DecompressRow(row);
+        }
+    }
+    void BspVisibility::DecompressRow(std::size_t row) const
+    {
+        std::lock_guard lock(m_DecompressMutex);
+
+        // Another thread could have decompressed it while waiting for the lock
+        if(m_RowDecompressed[row].load(std::memory_order_relaxed))
+            return;
+
+        const BspFile::Leaf& leaf = Bsp->GetRawLeaves()[row + 1];
+        uint64_t* words = m_Rows.data() + row * RowWords;
+        uint8_t* out = reinterpret_cast<uint8_t*>(words);
+        const std::size_t rowBytes = (LeafCount + 7) / 8;
+
+        if(leaf.VisOffset < 0)
+        {
+            // No visibility information = everything is visible
+            std::fill(words, words + RowWords, ~0ull);
+        }
+        else
+        {
+            const auto visibility = std::as_const(*Bsp).GetVisibility();
+            R_ASSERT(static_cast<std::size_t>(leaf.VisOffset) < visibility.size(), "Leaf visibility offset is outside of Visibility lump");
+
+            // RLE - non-zero byte is copied, zero byte is followed by number of zero bytes
+            const uint8_t* in = visibility.data() + leaf.VisOffset;
+            const uint8_t* inEnd = visibility.data() + visibility.size();
+            std::size_t written = 0;
+            while(written < rowBytes)
+            {
+                R_ASSERT(in < inEnd, "Visibility data of leaf " << (row + 1) << " end prematurely");
+
+                if(*in != 0)
+                {
+                    out[written++] = *in++;
+                    continue;
+                }
+
+                R_ASSERT(in + 1 < inEnd, "Visibility data of leaf " << (row + 1) << " end prematurely");
+                const std::size_t zeros = std::min<std::size_t>(in[1], rowBytes - written);
+                std::fill(out + written, out + written + zeros, 0);
+                written += zeros;
+                in += 2;
+            }
+        }
+
+        // Bits after last leaf must stay clear (for `Count` and iteration)
+        if(LeafCount % 64 != 0)
+            words[RowWords - 1] &= (1ull << (LeafCount % 64)) - 1;
+
+        m_RowDecompressed[row].store(true, std::memory_order_release);
+    }
+    std::vector<uint32_t> BspVisibility::VisibleLeaves(std::size_t leaf) const
+    {
+        const auto row = GetRow(leaf);
+
+        std::vector<uint32_t> leaves;
+        leaves.reserve(Count(row));
+        ForEachLeaf(row, [&leaves](uint32_t visibleLeaf) { leaves.emplace_back(visibleLeaf); });
+        return leaves;
+    }
+    std::vector<uint64_t> BspVisibility::Union(std::span<const uint32_t> leaves) const
+    {
+        std::vector<uint64_t> bits(RowWords, 0);
+        for(uint32_t leaf : leaves)
+        {
+            const auto row = GetRow(leaf);
+            if(!row.empty())
+                Or(bits, row);
+        }
+        return bits;
+    }
+    std::vector<uint64_t> BspVisibility::Intersection(std::span<const uint32_t> leaves) const
+    {
+        if(leaves.empty())
+            return std::vector<uint64_t>(RowWords, 0);
+
+        std::vector<uint64_t> bits(RowWords, ~0ull);
+        for(uint32_t leaf : leaves)
+        {
+            const auto row = GetRow(leaf);
+            if(row.empty())
+                return std::vector<uint64_t>(RowWords, 0);
+            And(bits, row);
+        }
+        return bits;
+    }
+    void BspVisibility::Or(std::span<uint64_t> out, std::span<const uint64_t> in) noexcept
+    {
+        D_ASSERT(out.size() == in.size(), "Bit sets must have same size");
+
+        std::size_t i = 0;
+#ifdef __SSE2__
+        for(; i + 2 <= out.size(); i += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out.data() + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.data() + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + i), _mm_or_si128(a, b));
+        }
+#endif
+        for(; i < out.size(); i++)
+            out[i] |= in[i];
+    }
+    void BspVisibility::And(std::span<uint64_t> out, std::span<const uint64_t> in) noexcept
+    {
+        D_ASSERT(out.size() == in.size(), "Bit sets must have same size");
+
+        std::size_t i = 0;
+#ifdef __SSE2__
+        for(; i + 2 <= out.size(); i += 2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out.data() + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in.data() + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + i), _mm_and_si128(a, b));
+        }
+#endif
+        for(; i < out.size(); i++)
+            out[i] &= in[i];
+    }
+    std::size_t BspVisibility::Count(std::span<const uint64_t> bits) noexcept
+    {
+        std::size_t count = 0;
+        for(uint64_t word : bits)
+            count += std::popcount(word);
+        return count;
+    }
+}
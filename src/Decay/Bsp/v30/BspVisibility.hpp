@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+
+namespace Decay::Bsp::v30
+{
+    /// Potentially Visible Set (PVS) from `Visibility` lump.
+    /// Every leaf has a row of bits, one for each other leaf (compressed by RLE inside the lump).
+    /// Rows are decompressed into 64-bit words either all at once or on first access (thread-safe).
+    class BspVisibility
+    {
+    public:
+        explicit BspVisibility(std::shared_ptr<BspFile> bsp, bool decompressAll = false);
+
+    public:
+        const std::shared_ptr<BspFile> Bsp;
+
+        /// Number of leaves with visibility information (from the main model).
+        /// Leaf 0 is the shared solid leaf and it is never visible.
+        const std::size_t LeafCount;
+        /// Number of 64-bit words in one row, bit `n` of a row represents leaf `n + 1`.
+        const std::size_t RowWords;
+
+    private:
+        /// `LeafCount` rows, row `n` is for leaf `n + 1`
+        mutable std::vector<uint64_t> m_Rows;
+        mutable std::unique_ptr<std::atomic<bool>[]> m_RowDecompressed;
+        mutable std::mutex m_DecompressMutex{};
+
+    private:
+        void DecompressRow(std::size_t row) const;
+
+    public:
+        /// Decompressed row of the leaf (bit `n` = leaf `n + 1`).
+        /// Leaf 0 (or leaf outside of `LeafCount`) sees nothing and returns empty span.
+        [[nodiscard]] inline std::span<const uint64_t> GetRow(std::size_t leaf) const
+        {
+            if(leaf == 0 || leaf > LeafCount) [[unlikely]]
+                return {};
+
+            const std::size_t row = leaf - 1;
+            if(!m_RowDecompressed[row].load(std::memory_order_acquire)) [[unlikely]]
+                DecompressRow(row);
+
+            return { m_Rows.data() + row * RowWords, RowWords };
+        }
+
+        /// Is `leafB` inside Potentially Visible Set of `leafA`.
+        [[nodiscard]] inline bool IsVisible(std::size_t leafA, std::size_t leafB) const
+        {
+            if(leafB == 0 || leafB > LeafCount) [[unlikely]]
+                return false;
+
+            const auto row = GetRow(leafA);
+            if(row.empty()) [[unlikely]]
+                return false;
+
+            const std::size_t bit = leafB - 1;
+            return (row[bit / 64] >> (bit % 64)) & 1u;
+        }
+
+        /// Call `func(leafIndex)` for every leaf visible from `leaf`.
+        template<typename TFunc>
+        inline void ForEachVisibleLeaf(std::size_t leaf, TFunc&& func) const
+        {
+            ForEachLeaf(GetRow(leaf), std::forward<TFunc>(func));
+        }
+        [[nodiscard]] std::vector<uint32_t> VisibleLeaves(std::size_t leaf) const;
+
+        /// Number of leaves visible from `leaf`.
+        [[nodiscard]] std::size_t CountVisible(std::size_t leaf) const { return Count(GetRow(leaf)); }
+
+        /// Union of PVS of all `leaves` (leaves visible from any of them).
+        [[nodiscard]] std::vector<uint64_t> Union(std::span<const uint32_t> leaves) const;
+        /// Intersection of PVS of all `leaves` (leaves visible from all of them).
+        [[nodiscard]] std::vector<uint64_t> Intersection(std::span<const uint32_t> leaves) const;
+
+    public:
+        /// `out |= in`, both must have same size
+        static void Or(std::span<uint64_t> out, std::span<const uint64_t> in) noexcept;
+        /// `out &= in`, both must have same size
+        static void And(std::span<uint64_t> out, std::span<const uint64_t> in) noexcept;
+        /// Number of set bits
+        [[nodiscard]] static std::size_t Count(std::span<const uint64_t> bits) noexcept;
+
+        /// Call `func(leafIndex)` for every set bit of a row (bit `n` = leaf `n + 1`).
+        template<typename TFunc>
+        static inline void ForEachLeaf(std::span<const uint64_t> bits, TFunc&& func)
+        {
+            for(std::size_t wi = 0; wi < bits.size(); wi++)
+            {
+                uint64_t word = bits[wi];
+                while(word != 0)
+                {
+                    const int bit = std::countr_zero(word);
+                    func(static_cast<uint32_t>(wi * 64 + bit + 1));
+                    word &= word - 1; // Clear lowest set bit
+                }
+            }
+        }
+    };
+}
@@ -11,6 +11,8 @@
 #include <set>
 #include <optional>
 #include <filesystem>
+#include <exception>
+#include <thread>
 #include "glm/glm.hpp"
 
 #include <stb_image_write.h>
@@ -518,4 +520,63 @@ namespace Decay
     }
 #   pragma endregion
 #pragma endregion
+
+#pragma region Parallel
+    /// Splits `[0, count)` into `threadCount` contiguous ranges (0 = number of CPU threads)
+    /// and calls `func(begin, end)` for each of them, the first one on the calling thread.
+    /// Ranges whose thread could not be created also run on the calling thread.
+    /// Exception from the lowest range is rethrown after all threads finished.
+    template<typename TFunc>
+    inline void ParallelFor(std::size_t count, std::size_t threadCount, const TFunc& func)
+    {
+        if(threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::min(threadCount, count);
+
+        if(threadCount <= 1)
+        {
+            if(count != 0)
+                func(std::size_t(0), count);
+            return;
+        }
+
+        const std::size_t chunk = (count + threadCount - 1) / threadCount;
+        std::vector<std::exception_ptr> exceptions(threadCount);
+        const auto runRange = [&func, &exceptions, chunk, count](std::size_t t)
+        {
+            try
+            {
+                const std::size_t begin = std::min(t * chunk, count);
+                func(begin, std::min(begin + chunk, count));
+            }
+            catch(...)
+            {
+                exceptions[t] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        std::size_t started = 1;
+        try
+        {
+            for(; started < threadCount; started++)
+                threads.emplace_back(runRange, started);
+        }
+        catch(...)
+        {
+            // Thread could not be created (`std::system_error`), ranges without thread run on this one
+        }
+        runRange(0);
+        for(std::size_t t = started; t < threadCount; t++)
+            runRange(t);
+
+        for(std::thread& thread : threads)
+            thread.join();
+
+        for(const std::exception_ptr& exception : exceptions)
+            if(exception)
+                std::rethrow_exception(exception);
+    }
+#pragma endregion
 }
@@ -0,0 +1,88 @@
+#include "MemoryMappedFile.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+namespace Decay
+{
+    MemoryMappedFile::MemoryMappedFile(const std::filesystem::path& filename) : Path(filename)
+    {
+        if(!std::filesystem::exists(filename))
+            throw std::runtime_error("File not found");
+
+#ifdef _WIN32
+        HANDLE file = CreateFileW(filename.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open file for memory mapping");
+
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to memory map empty file");
+        }
+        m_Size = static_cast<std::size_t>(fileSize.QuadPart);
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if(mapping == nullptr)
+        {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to create file mapping");
+        }
+
+        void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        if(data == nullptr)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            throw std::runtime_error("Failed to map view of file");
+        }
+
+        m_FileHandle = file;
+        m_MappingHandle = mapping;
+        m_Data = static_cast<char*>(data);
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if(fd == -1)
+            throw std::runtime_error("Failed to open file for memory mapping");
+
+        struct stat fileStat{};
+        if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to memory map empty file");
+        }
+        m_Size = static_cast<std::size_t>(fileStat.st_size);
+
+        // Private mapping = writes go into copied pages, not into the file
+        void* data = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd); // Mapping keeps its own reference to the file
+        if(data == MAP_FAILED)
+            throw std::runtime_error("Failed to memory map file");
+
+        m_Data = static_cast<char*>(data);
+#endif
+    }
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+#ifdef _WIN32
+        if(m_Data)
+            UnmapViewOfFile(m_Data);
+        if(m_MappingHandle)
+            CloseHandle(m_MappingHandle);
+        if(m_FileHandle)
+            CloseHandle(m_FileHandle);
+#else
+        if(m_Data)
+            munmap(m_Data, m_Size);
+#endif
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filesystem>
+
+namespace Decay
+{
+    /// Whole file mapped into memory.
+    /// Pages are mapped as private (copy-on-write) - writing into the memory never reaches the file.
+    class MemoryMappedFile
+    {
+    public:
+        explicit MemoryMappedFile(const std::filesystem::path& filename);
+        ~MemoryMappedFile();
+
+        MemoryMappedFile(const MemoryMappedFile&) = delete;
+        MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    public:
+        const std::filesystem::path Path;
+
+    private:
+        char* m_Data = nullptr;
+        std::size_t m_Size = 0;
+#ifdef _WIN32
+        void* m_FileHandle = nullptr;
+        void* m_MappingHandle = nullptr;
+#endif
+
+    public:
+        [[nodiscard]] inline       char* data()       noexcept { return m_Data; }
+        [[nodiscard]] inline const char* data() const noexcept { return m_Data; }
+        [[nodiscard]] inline std::size_t size() const noexcept { return m_Size; }
+
+        [[nodiscard]] inline bool Contains(const void* ptr) const noexcept
+        {
+            return ptr >= m_Data && ptr < m_Data + m_Size;
+        }
+    };
+}
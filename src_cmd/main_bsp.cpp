@@ -21,6 +21,11 @@ cxxopts::Options Options_bsp2obj(int argc, const char** argv)
        ("obj", "OBJ file (result 3D model)", cxxopts::value<std::string>(), "<map.obj>")
        ("mtl", "MTL file (texture mapping for OBJ file)", cxxopts::value<std::string>(), "<map.mtl>")
        ("textures", "Export textures to directory", cxxopts::value<std::string>(), "<texture_directory>")
+       ("optimize", "Reorder triangles and vertices for GPU vertex cache before export")
+       ("smooth", "Smooth normals of faces with the same texture which meet under the angle", cxxopts::value<float>(), "<degrees>")
+       ("glb", "Binary glTF file (textures packed in BSP and lightmaps are embedded)", cxxopts::value<std::string>(), "<map.glb>")
+       ("quantize", "Store GLB vertices as 16-bit integers (KHR_mesh_quantization)")
+       ("models", "Export every brush model into its own OBJ file in its local space (`model_<N>.obj`)", cxxopts::value<std::string>(), "<model_directory>")
     ;
 
     options.positional_help("-f <map.bsp> ...");
@@ -69,7 +74,7 @@ int Exec_bsp2obj(int argc, const char** argv)
             std::cerr << "WARNING: BSP file path should have `.bsp` extension" << std::endl;
         try
         {
-            bsp = std::make_shared<BspFile>(bspPath);
+            bsp = std::make_shared<BspFile>(bspPath, BspFile::LoadMode::MemoryMap);
         }
         catch(std::runtime_error& ex)
         {
@@ -83,7 +88,7 @@ int Exec_bsp2obj(int argc, const char** argv)
         }
         try
         {
-            bspTree = std::make_shared<BspTree>(bsp);
+            bspTree = std::make_shared<BspTree>(bsp, 0, result.count("smooth") ? result["smooth"].as<float>() : 0.0f);
         }
         catch(std::runtime_error& ex)
         {
@@ -98,6 +103,11 @@ int Exec_bsp2obj(int argc, const char** argv)
     }
 #pragma endregion
 
+#pragma region --optimize
+    if(result.count("optimize"))
+        bspTree->OptimizeMeshes();
+#pragma endregion
+
 #pragma region --obj
     std::filesystem::path objPath = {};
     if(result.count("obj"))
@@ -171,6 +181,44 @@ int Exec_bsp2obj(int argc, const char** argv)
     }
 #pragma endregion
 
+#pragma region --glb
+    std::filesystem::path glbPath = {};
+    if(result.count("glb"))
+    {
+        glbPath = result["glb"].as<std::string>();
+        if(std::filesystem::exists(glbPath) && !std::filesystem::is_regular_file(glbPath))
+        {
+            const char* errorMsg = "`--glb` must point to non-existing file or existing valid file (if you do not want to export as glTF into a file, omit `--glb`)";
+#ifdef DEBUG
+            throw std::runtime_error(errorMsg);
+#else
+            std::cerr << errorMsg << std::endl;
+#endif
+            return 1;
+        }
+        if(glbPath.extension() != ".glb")
+            std::cerr << "WARNING: GLB file path should have `.glb` extension" << std::endl;
+    }
+#pragma endregion
+
+#pragma region --models
+    std::filesystem::path modelsDir = {};
+    if(result.count("models"))
+    {
+        modelsDir = result["models"].as<std::string>();
+        if(std::filesystem::exists(modelsDir) && !std::filesystem::is_directory(modelsDir))
+        {
+            const char* errorMsg = "`--models` must point to a valid directory or path where a directory can be created";
+#ifdef DEBUG
+            throw std::runtime_error(errorMsg);
+#else
+            std::cerr << errorMsg << std::endl;
+#endif
+            return 1;
+        }
+    }
+#pragma endregion
+
 #pragma region OBJ export
     if(!objPath.empty())
     {
@@ -194,6 +242,61 @@ int Exec_bsp2obj(int argc, const char** argv)
     }
 #pragma endregion
 
+#pragma region GLB export
+    if(!glbPath.empty())
+    {
+        try
+        {
+            bspTree->ExportGlb(
+                glbPath,
+                true,
+                texturesDir.empty() ? std::filesystem::path(".") : std::filesystem::relative(texturesDir, glbPath.parent_path()),
+                result.count("quantize") != 0
+            );
+        }
+        catch(std::exception& ex)
+        {
+            const char* errorMsg = "`--glb` could not be exported - ";
+#ifdef DEBUG
+            throw std::runtime_error(errorMsg + std::string(ex.what()));
+#else
+            std::cerr << errorMsg << ex.what() << std::endl;
+#endif
+            return 1;
+        }
+    }
+#pragma endregion
+
+#pragma region Model export
+    if(!modelsDir.empty())
+    {
+        try
+        {
+            std::filesystem::create_directories(modelsDir);
+
+            const std::filesystem::path modelMtlPath = mtlPath.empty() ? std::filesystem::path{} : std::filesystem::relative(mtlPath, modelsDir);
+            for(std::size_t mi = 0; mi < bspTree->Models.size(); mi++)
+            {
+                bspTree->ExportModelObj(
+                    bspTree->GetModelMesh(mi),
+                    modelsDir / ("model_" + std::to_string(mi) + ".obj"),
+                    modelMtlPath
+                );
+            }
+        }
+        catch(std::exception& ex)
+        {
+            const char* errorMsg = "`--models` could not be exported - ";
+#ifdef DEBUG
+            throw std::runtime_error(errorMsg + std::string(ex.what()));
+#else
+            std::cerr << errorMsg << ex.what() << std::endl;
+#endif
+            return 1;
+        }
+    }
+#pragma endregion
+
 #pragma region MTL export
     if(!mtlPath.empty())
     {
@@ -283,7 +386,7 @@ int Exec_bsp2wad(int argc, const char** argv)
     {
         try
         {
-            bsp = std::make_shared<BspFile>(bspPath);
+            bsp = std::make_shared<BspFile>(bspPath, BspFile::LoadMode::Lazy);
         }
         catch(std::runtime_error& ex)
         {
@@ -325,10 +428,12 @@ int Exec_bsp2wad(int argc, const char** argv)
 
 #pragma region Textures
         using namespace Decay::Wad::Wad3;
-        auto textures = bsp->GetTextures();
+        auto infos = bsp->GetTextureInfos();
 
-        for(std::size_t i = 0; i < textures.size(); i++) // NOLINT(modernize-loop-convert)
-            textures[i] = textures[i].CopyWithoutData();
+        std::vector<WadFile::Texture> textures;
+        textures.reserve(infos.size());
+        for(const auto& info : infos)
+            textures.emplace_back(info.Name, info.Size);
 
         bsp->SetTextures(textures);
 #pragma endregion
@@ -435,7 +540,7 @@ int Exec_bsp_lightmap(int argc, const char** argv)
     {
         try
         {
-            bsp = std::make_shared<BspFile>(bspPath);
+            bsp = std::make_shared<BspFile>(bspPath, BspFile::LoadMode::MemoryMap);
         }
         catch(std::runtime_error& ex)
         {
@@ -469,7 +574,23 @@ int Exec_bsp_lightmap(int argc, const char** argv)
         std::function<void(const char* path, uint32_t width, uint32_t height, const glm::u8vec3* data)> writeFunc = Decay::ImageWriteFunction_RGB(extension);
         R_ASSERT(writeFunc != nullptr, "Lightmap path must have a supported extension - unsupported extension");
 
-        writeFunc(lightmapPath.string().c_str(), bspTree->Light.Width, bspTree->Light.Height, bspTree->Light.Data.data());
+        // First page keeps the given name, others get `_<page>` suffix, additional style layers get `_style<layer>` suffix
+        for(std::size_t page = 0; page < bspTree->Lightmaps.size(); page++)
+        {
+            const BspTree::Lightmap& lightmap = bspTree->Lightmaps[page];
+            for(std::size_t layer = 0; layer < lightmap.Layers.size(); layer++)
+            {
+                std::string name = lightmapPath.stem().string();
+                if(page != 0)
+                    name += '_' + std::to_string(page);
+                if(layer != 0)
+                    name += "_style" + std::to_string(layer);
+
+                std::filesystem::path layerPath = lightmapPath;
+                layerPath.replace_filename(name + extension);
+                writeFunc(layerPath.string().c_str(), lightmap.Width, lightmap.Height, lightmap.Layers[layer].data());
+            }
+        }
     }
     else
         return 1;
@@ -526,14 +647,14 @@ int Exec_bsp_entity(int argc, const char** argv)
 
 #pragma region --file
     std::shared_ptr<BspFile> bsp{}; ///< Can be NULL
+    std::filesystem::path bspPath{};
     if(result.count("file"))
     {
-        std::filesystem::path bspPath{};
         if(GetFilePath_Existing(result, "file", bspPath, ".bsp"))
         {
             try
             {
-                bsp = std::make_shared<BspFile>(bspPath);
+                bsp = std::make_shared<BspFile>(bspPath, BspFile::LoadMode::Lazy);
                 R_ASSERT(bsp != nullptr, "Failed to load BSP");
                 entities = BspEntities(*bsp);
             }
@@ -748,11 +869,19 @@ int Exec_bsp_entity(int argc, const char** argv)
         std::filesystem::path outBspPath{};
         if(GetFilePath_NewOrOverride(result, "outbsp", outBspPath, ".bsp"))
         {
-            std::fstream out(outBspPath, std::ios_base::out | std::ios_base::binary);
+            // Only entities changed, no need to rewrite whole BSP
+            try
             {
-                bsp->SetEntities(to_string(entities));
+                if(!std::filesystem::exists(outBspPath) || !std::filesystem::equivalent(bspPath, outBspPath))
+                    std::filesystem::copy_file(bspPath, outBspPath, std::filesystem::copy_options::overwrite_existing);
+
+                BspFile::PatchEntities(outBspPath, to_string(entities));
+            }
+            catch(std::exception& ex)
+            {
+                std::cerr << "Failed to save entities into BSP file - " << ex.what() << std::endl;
+                return 1;
             }
-            out << bsp;
         }
         else
             return 1;
@@ -0,0 +1,85 @@
+#include <cmath>
+#include <iostream>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+#include "Decay/Bsp/v30/BspBvh.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    auto tree = std::make_shared<BspTree>(bsp);
+    BspBvh bvh(*tree);
+
+    std::cout << "de_dust2.bsp:" << std::endl;
+    std::cout << "- Triangles: " << bvh.GetTriangles().size() << std::endl;
+    std::cout << "- Nodes: " << bvh.GetNodes().size() << std::endl;
+    R_ASSERT(!bvh.GetTriangles().empty(), "BVH has no triangles");
+
+    // Rays from the middle of the world into every direction
+    const BspFile::Model& world = bsp->GetMainModel();
+    const glm::vec3 center = (world.bbMin + world.bbMax) * 0.5f;
+    std::vector<BspBvh::Ray> rays;
+    for(int pitch = -8; pitch <= 8; pitch++)
+    {
+        for(int yaw = 0; yaw < 32; yaw++)
+        {
+            const float p = static_cast<float>(pitch) / 8.0f * 1.5f;
+            const float y = static_cast<float>(yaw) / 32.0f * 6.2831853f;
+            rays.push_back({ center, glm::vec3(std::cos(p) * std::cos(y), std::cos(p) * std::sin(y), std::sin(p)) });
+        }
+    }
+
+    std::vector<BspBvh::Hit> hits(rays.size());
+    bvh.Intersect(rays, hits);
+
+    std::size_t hitCount = 0;
+    std::vector<BspBvh::TriangleInfo> faces;
+    for(std::size_t i = 0; i < rays.size(); i++)
+    {
+        const BspBvh::Hit single = bvh.Intersect(rays[i]);
+        // Different triangle can be found when the ray hits their shared edge
+        R_ASSERT(single.IsHit() == hits[i].IsHit(), "Packet and single ray " << i << " differ");
+        R_ASSERT(!single.IsHit() || std::abs(single.Distance - hits[i].Distance) <= single.Distance * 1e-4f, "Packet and single ray " << i << " differ");
+
+        // Brute force over all triangles has to find the same distance
+        float closest = std::numeric_limits<float>::infinity();
+        for(const BspBvh::Triangle& triangle : bvh.GetTriangles())
+        {
+            const glm::vec3 p = glm::cross(rays[i].Direction, triangle.Edge2);
+            const float det = glm::dot(triangle.Edge1, p);
+            if(std::abs(det) < 1e-12f)
+                continue;
+            const glm::vec3 s = rays[i].Origin - triangle.V0;
+            const float inverseDet = 1.0f / det;
+            const float u = glm::dot(s, p) * inverseDet;
+            const glm::vec3 q = glm::cross(s, triangle.Edge1);
+            const float v = glm::dot(rays[i].Direction, q) * inverseDet;
+            const float t = glm::dot(triangle.Edge2, q) * inverseDet;
+            if(u >= 0 && u <= 1 && v >= 0 && u + v <= 1 && t >= 0)
+                closest = std::min(closest, t);
+        }
+        R_ASSERT(closest == single.Distance || std::abs(closest - single.Distance) <= closest * 1e-4f, "BVH missed the closest triangle of ray " << i);
+
+        if(!single.IsHit())
+            continue;
+        hitCount++;
+
+        const glm::vec3 point = rays[i].Origin + rays[i].Direction * single.Distance;
+        R_ASSERT(bvh.IsOccluded(rays[i].Origin, point + rays[i].Direction), "Hit point of ray " << i << " is not occluded");
+
+        bvh.QueryRadius(point, 1.0f, faces);
+        R_ASSERT(std::find(faces.begin(), faces.end(), single.Info) != faces.end(), "Radius query missed face of ray " << i);
+
+        bvh.QueryBox(point - glm::vec3(1), point + glm::vec3(1), faces);
+        R_ASSERT(std::find(faces.begin(), faces.end(), single.Info) != faces.end(), "Box query missed face of ray " << i);
+        R_ASSERT(single.Info.Texture < tree->Textures.size(), "Hit texture is outside of bounds");
+    }
+
+    std::cout << "- Ray hits: " << hitCount << " / " << rays.size() << std::endl;
+    R_ASSERT(hitCount > 0, "No ray hit anything");
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+
+    auto tree = std::make_shared<BspTree>(bsp);
+    tree->ExportGlb("de_dust2.glb");
+    tree->ExportGlb("de_dust2_textures.glb", false, "textures");
+    tree->ExportGlb("de_dust2_quantized.glb", true, ".", true);
+
+    // Packed vertices are within half of quantization step
+    for(const auto& model : tree->Models)
+    {
+        const BspTree::VertexQuantization quantization = tree->GetVertexQuantization(*model);
+        const auto vertices = tree->GetModelVertices(*model);
+        const std::vector<BspTree::PackedVertex> packed = tree->GetPackedVertices(*model, quantization);
+        R_ASSERT(packed.size() == vertices.size(), "Packed vertices do not match vertices of the model");
+
+        // Whole 16-bit range covers exactly the vertices, no matter the bounding box stored in the file
+        for(int c = 0; c < 3 && !vertices.empty(); c++)
+        {
+            float min = vertices[0].Position[c], max = min;
+            for(const auto& vertex : vertices)
+            {
+                min = std::min(min, vertex.Position[c]);
+                max = std::max(max, vertex.Position[c]);
+            }
+            R_ASSERT(quantization.PositionOffset[c] == min, "Quantization does not start at the lowest vertex");
+            R_ASSERT(std::abs(quantization.PositionOffset[c] + quantization.PositionScale[c] * 65535.0f - max) < 0.001f, "Quantization does not end at the highest vertex");
+        }
+
+        for(std::size_t i = 0; i < vertices.size(); i++)
+        {
+            const BspTree::Vertex decoded = BspTree::DecodeVertex(packed[i], quantization);
+            R_ASSERT(decoded.LightmapPage == vertices[i].LightmapPage, "Lightmap page changed by packing");
+            R_ASSERT(glm::dot(decoded.Normal, vertices[i].Normal) > 0.999f && decoded.Tangent.w == vertices[i].Tangent.w, "Packed normal or tangent is too far");
+            for(int c = 0; c < 3; c++)
+                R_ASSERT(std::abs(decoded.Position[c] - vertices[i].Position[c]) <= quantization.PositionScale[c] * 0.5f + 0.001f, "Packed position is too far");
+            for(int c = 0; c < 2; c++)
+            {
+                R_ASSERT(std::abs(decoded.UV[c] - vertices[i].UV[c]) <= quantization.UVScale[c] * 0.5f + 0.0001f, "Packed UV is too far");
+                R_ASSERT(std::abs(decoded.LightUV[c] - vertices[i].LightUV[c]) <= quantization.LightScale[c] * 0.5f + 0.00001f, "Packed lightmap UV is too far");
+            }
+        }
+    }
+
+    // Header and chunks cover the whole file
+    for(const char* filename : { "de_dust2.glb", "de_dust2_textures.glb", "de_dust2_quantized.glb" })
+    {
+        std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+        R_ASSERT(in.good(), "GLB file was not written");
+
+        uint32_t header[5];
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        R_ASSERT(header[0] == 0x46546C67u && header[1] == 2, "Invalid GLB header");
+        R_ASSERT(header[3] % 4 == 0 && header[4] == 0x4E4F534Au, "First chunk is not padded JSON");
+
+        in.seekg(0, std::ios_base::end);
+        const std::size_t length = in.tellg();
+        R_ASSERT(header[2] == length, "GLB length does not match file size");
+
+        in.seekg(sizeof(header) + header[3]);
+        uint32_t binHeader[2];
+        in.read(reinterpret_cast<char*>(binHeader), sizeof(binHeader));
+        R_ASSERT(binHeader[1] == 0x004E4942u, "Second chunk is not BIN");
+        R_ASSERT(sizeof(header) + header[3] + sizeof(binHeader) + binHeader[0] == length, "Chunks do not cover the file");
+
+        std::cout << filename << ": " << length << " bytes" << std::endl;
+    }
+}
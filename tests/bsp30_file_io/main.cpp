@@ -0,0 +1,182 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+
+    auto bspMapped = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp", BspFile::LoadMode::MemoryMap);
+    R_ASSERT(bspMapped->IsMemoryMapped(), "BSP file was not memory-mapped");
+    for(std::size_t i = 0; i < BspFile::LumpType_Size; i++)
+    {
+        R_ASSERT(bsp->m_DataLength[i] == bspMapped->m_DataLength[i], "Lump " << i << " of memory-mapped BSP has different length");
+        R_ASSERT(std::equal(
+            static_cast<const char*>(bsp->m_Data[i]),
+            static_cast<const char*>(bsp->m_Data[i]) + bsp->m_DataLength[i],
+            static_cast<const char*>(bspMapped->m_Data[i])
+        ), "Lump " << i << " of memory-mapped BSP has different content");
+    }
+
+    auto bspLazy = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp", BspFile::LoadMode::Lazy);
+    R_ASSERT(!bspLazy->IsLumpLoaded(BspFile::LumpType::Entities), "Lazy BSP loaded lump before it was accessed");
+    R_ASSERT(bspLazy->GetEntityCharCount() == bsp->GetEntityCharCount(), "Lazy BSP has different entity lump length");
+    R_ASSERT(std::equal(
+        bsp->GetRawEntityChars(),
+        bsp->GetRawEntityChars() + bsp->GetEntityCharCount(),
+        bspLazy->GetRawEntityChars()
+    ), "Lazy BSP has different entities");
+    R_ASSERT(bspLazy->IsLumpLoaded(BspFile::LumpType::Entities), "Lazy BSP did not mark accessed lump as loaded");
+    R_ASSERT(!bspLazy->IsLumpLoaded(BspFile::LumpType::Lighting), "Lazy BSP loaded lump which was not accessed");
+
+    // BSP stored inside another stream (not starting at index 0)
+    {
+        std::ifstream file("../../../half-life/cstrike/maps/de_dust2.bsp", std::ios_base::binary | std::ios_base::in);
+        std::stringstream ss(std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+        ss << "Prefix before BSP data";
+        ss << file.rdbuf();
+        ss.seekg(std::string_view("Prefix before BSP data").size());
+
+        auto bspStream = std::make_shared<BspFile>(ss);
+        R_ASSERT(bspStream->GetFaceCount() == bsp->GetFaceCount(), "BSP from stream has different face count");
+
+        std::string data = ss.str().substr(std::string_view("Prefix before BSP data").size());
+        auto bspMemory = std::make_shared<BspFile>(data.data(), data.size());
+        R_ASSERT(bspMemory->GetEdgeCount() == bsp->GetEdgeCount(), "BSP from memory has different edge count");
+
+        // Borrowed memory is written in place, copied memory is not
+        auto bspBorrowed = std::make_shared<BspFile>(std::span<char>(data));
+        R_ASSERT(bspBorrowed->GetEdgeCount() == bsp->GetEdgeCount(), "BSP from borrowed memory has different edge count");
+        R_ASSERT(bspBorrowed->GetVertexCount() > 0, "BSP has no vertices");
+        const glm::vec3 originalVertex = bspMemory->GetVertices()[0];
+        bspBorrowed->GetVertices()[0].x += 1.0f;
+        R_ASSERT(bspBorrowed->GetVertices()[0].x == originalVertex.x + 1.0f, "Vertex of borrowed BSP was not changed");
+        R_ASSERT(bspMemory->GetVertices()[0] == originalVertex, "Vertex of copied BSP was changed through borrowed memory");
+        R_ASSERT(reinterpret_cast<const glm::vec3*>(data.data() + bspBorrowed->m_DataOffset[static_cast<std::size_t>(BspFile::LumpType::Vertices)])->x == originalVertex.x + 1.0f, "Borrowed BSP did not write into its memory");
+
+        // Misaligned memory, only lumps of bytes can be borrowed
+        const std::string original = ss.str().substr(std::string_view("Prefix before BSP data").size());
+        std::vector<char> shifted(original.size() + 1);
+        std::copy(original.begin(), original.end(), shifted.begin() + 1);
+        auto bspShifted = std::make_shared<BspFile>(std::span<char>(shifted).subspan(1));
+        for(std::size_t i = 0; i < BspFile::LumpType_Size; i++)
+        {
+            R_ASSERT(reinterpret_cast<std::uintptr_t>(bspShifted->m_Data[i]) % BspFile::s_DataElementAlignment[i] == 0, "Lump " << i << " of misaligned BSP is not aligned");
+            R_ASSERT(bspShifted->m_DataOwned[i] == (BspFile::s_DataElementAlignment[i] > 1), "Lump " << i << " of misaligned BSP was not copied exactly when misaligned");
+            R_ASSERT(std::equal(
+                static_cast<const char*>(bsp->m_Data[i]),
+                static_cast<const char*>(bsp->m_Data[i]) + bsp->m_DataLength[i],
+                static_cast<const char*>(bspShifted->m_Data[i])
+            ), "Lump " << i << " of misaligned BSP has different content");
+        }
+    }
+
+    // Saved BSP loads back with the same lumps, with and without padding between lumps
+    for(bool alignLumps : { true, false })
+    {
+        const std::filesystem::path filename = alignLumps ? "de_dust2_aligned.bsp" : "de_dust2_packed.bsp";
+        bsp->Save(filename, alignLumps);
+
+        for(BspFile::LoadMode mode : { BspFile::LoadMode::Copy, BspFile::LoadMode::MemoryMap })
+        {
+            auto bspSaved = std::make_shared<BspFile>(filename, mode);
+            for(std::size_t i = 0; i < BspFile::LumpType_Size; i++)
+            {
+                if(alignLumps)
+                    R_ASSERT(bspSaved->m_DataOffset[i] % BspFile::LumpAlignment == 0, "Lump " << i << " of saved BSP is not aligned");
+                R_ASSERT(bspSaved->m_DataLength[i] == bsp->m_DataLength[i], "Lump " << i << " of saved BSP has different length");
+                R_ASSERT(std::equal(
+                    static_cast<const char*>(bsp->m_Data[i]),
+                    static_cast<const char*>(bsp->m_Data[i]) + bsp->m_DataLength[i],
+                    static_cast<const char*>(bspSaved->m_Data[i])
+                ), "Lump " << i << " of saved BSP has different content");
+            }
+        }
+    }
+
+    // Entities patched directly in the file
+    {
+        const auto readFile = [](const std::filesystem::path& filename)
+        {
+            std::ifstream in(filename, std::ios_base::binary | std::ios_base::in);
+            std::stringstream content;
+            content << in.rdbuf();
+            return content.str();
+        };
+        const std::string original = readFile("de_dust2_aligned.bsp");
+        const BspFile bspOriginal("de_dust2_aligned.bsp");
+        const std::size_t entitiesIndex = static_cast<std::size_t>(BspFile::LumpType::Entities);
+        const std::size_t entitiesOffset = bspOriginal.m_DataOffset[entitiesIndex];
+        const std::size_t entitiesLength = bspOriginal.m_DataLength[entitiesIndex];
+        // Magic + offset and length of every lump
+        const std::size_t headerSize = sizeof(uint32_t) + BspFile::LumpType_Size * 2 * sizeof(uint32_t);
+
+        // Shorter lump is overwritten in place, rest of the old lump is cleared
+        {
+            std::filesystem::copy_file("de_dust2_aligned.bsp", "de_dust2_patched.bsp", std::filesystem::copy_options::overwrite_existing);
+            const std::string entities = "{\n\"classname\" \"worldspawn\"\n}\n";
+            R_ASSERT(entities.size() + 1 < entitiesLength, "Test entities are not shorter than the original ones");
+            R_ASSERT(BspFile::PatchEntities("de_dust2_patched.bsp", entities), "Shorter entities were not patched in place");
+
+            const std::string patched = readFile("de_dust2_patched.bsp");
+            R_ASSERT(patched.size() == original.size(), "Patching shorter entities changed file size");
+            R_ASSERT(patched.compare(entitiesOffset, entities.size() + 1, std::string_view(entities.c_str(), entities.size() + 1)) == 0, "Patched entities were not written");
+            for(std::size_t i = entitiesOffset + entities.size() + 1; i < entitiesOffset + entitiesLength; i++)
+                R_ASSERT(patched[i] == '\0', "Rest of the old entities lump was not cleared");
+            R_ASSERT(patched.compare(entitiesOffset + entitiesLength, std::string::npos, original, entitiesOffset + entitiesLength) == 0, "Patching entities changed data after the lump");
+
+            auto bspPatched = std::make_shared<BspFile>("de_dust2_patched.bsp");
+            R_ASSERT(bspPatched->m_DataOffset[entitiesIndex] == entitiesOffset, "Entities patched in place were moved");
+            R_ASSERT(std::string_view(bspPatched->GetRawEntityChars()) == entities, "Patched BSP has different entities");
+            for(std::size_t i = 0; i < BspFile::LumpType_Size; i++)
+            {
+                if(i == entitiesIndex)
+                    continue;
+                R_ASSERT(bspPatched->m_DataLength[i] == bsp->m_DataLength[i], "Lump " << i << " of patched BSP has different length");
+                R_ASSERT(std::equal(
+                    static_cast<const char*>(bsp->m_Data[i]),
+                    static_cast<const char*>(bsp->m_Data[i]) + bsp->m_DataLength[i],
+                    static_cast<const char*>(bspPatched->m_Data[i])
+                ), "Lump " << i << " of patched BSP has different content");
+            }
+        }
+
+        // Longer lump is appended at the end of the file, only the header points to it
+        {
+            std::filesystem::copy_file("de_dust2_aligned.bsp", "de_dust2_patched.bsp", std::filesystem::copy_options::overwrite_existing);
+            const std::string entities = std::string(bsp->GetRawEntityChars()) + "{\n\"classname\" \"info_null\"\n\"targetname\" \"patched\"\n}\n";
+            R_ASSERT(!BspFile::PatchEntities("de_dust2_patched.bsp", entities), "Longer entities were patched in place");
+
+            const std::size_t appendedOffset = (original.size() + BspFile::LumpAlignment - 1) / BspFile::LumpAlignment * BspFile::LumpAlignment;
+            const std::string patched = readFile("de_dust2_patched.bsp");
+            R_ASSERT(patched.size() == appendedOffset + entities.size() + 1, "Appended entities have unexpected size");
+            R_ASSERT(patched.compare(headerSize, original.size() - headerSize, original, headerSize) == 0, "Appending entities changed data after the header");
+
+            auto bspPatched = std::make_shared<BspFile>("de_dust2_patched.bsp");
+            bspPatched->Validate();
+            R_ASSERT(bspPatched->m_DataOffset[entitiesIndex] == appendedOffset, "Header does not point to appended entities");
+            R_ASSERT(std::string_view(bspPatched->GetRawEntityChars()) == entities, "Patched BSP has different entities");
+            for(std::size_t i = 0; i < BspFile::LumpType_Size; i++)
+            {
+                if(i == entitiesIndex)
+                    continue;
+                R_ASSERT(bspPatched->m_DataOffset[i] == bspOriginal.m_DataOffset[i], "Lump " << i << " of patched BSP was moved");
+                R_ASSERT(std::equal(
+                    static_cast<const char*>(bsp->m_Data[i]),
+                    static_cast<const char*>(bsp->m_Data[i]) + bsp->m_DataLength[i],
+                    static_cast<const char*>(bspPatched->m_Data[i])
+                ), "Lump " << i << " of patched BSP has different content");
+            }
+        }
+    }
+
+    for(const char* filename : { "de_dust2_aligned.bsp", "de_dust2_packed.bsp", "de_dust2_patched.bsp" })
+        std::filesystem::remove(filename);
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspNodeTree.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    BspNodeTree tree(bsp);
+
+    const BspFile::Model& world = bsp->GetMainModel();
+    const glm::vec3 size = world.bbMax - world.bbMin;
+
+    // Regular grid over the whole world, also covering solid space outside of the map
+    std::vector<glm::vec3> points;
+    constexpr int Steps = 37;
+    for(int x = 0; x <= Steps; x++)
+        for(int y = 0; y <= Steps; y++)
+            for(int z = 0; z <= Steps; z++)
+                points.emplace_back(world.bbMin + size * glm::vec3(x, y, z) / static_cast<float>(Steps));
+
+    const auto leaves = tree.FindLeaves(points);
+    R_ASSERT(leaves.size() == points.size(), "Not every point got its leaf");
+
+    std::size_t emptyPoints = 0;
+    for(std::size_t i = 0; i < points.size(); i++)
+    {
+        R_ASSERT(leaves[i] == tree.FindLeaf(points[i]), "Batched and single lookup of point " << i << " differ");
+        R_ASSERT(leaves[i] < bsp->GetLeafCount(), "Point " << i << " is inside of leaf outside of bounds");
+
+        const BspFile::Leaf& leaf = bsp->GetRawLeaves()[leaves[i]];
+        if(leaf.Content == BspFile::LeafContent::Solid)
+            continue;
+        emptyPoints++;
+
+        // Leaf bounding box is rounded to whole units
+        for(int axis = 0; axis < 3; axis++)
+        {
+            R_ASSERT(points[i][axis] >= leaf.bbMin[axis] - 1 && points[i][axis] <= leaf.bbMax[axis] + 1,
+                     "Point " << i << " is outside of its leaf " << leaves[i]);
+        }
+    }
+
+    std::cout << "de_dust2.bsp:" << std::endl;
+    std::cout << "- Points: " << points.size() << std::endl;
+    std::cout << "- Non-solid points: " << emptyPoints << std::endl;
+    R_ASSERT(emptyPoints > 0, "Every point is in solid space");
+
+    return 0;
+}
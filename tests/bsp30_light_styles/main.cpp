@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <iostream>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+#include "Decay/Bsp/v30/BspLightStyles.hpp"
+#include "Decay/Bsp/v30/BspLightmapCompositor.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    auto tree = std::make_shared<BspTree>(bsp);
+    BspLightStyles styles(tree->Entities);
+
+    // Built-in styles
+    R_ASSERT(styles.GetBrightness(0, 0) == 12 * BspLightStyles::BrightnessStep, "Normal style is not 'm'");
+    R_ASSERT(!styles.IsAnimated(0), "Normal style is animated");
+    R_ASSERT(styles.IsAnimated(10), "Fluorescent flicker is not animated");
+    R_ASSERT(styles.GetBrightness(4, 0) == 12 * BspLightStyles::BrightnessStep, "Fast strobe does not start at 'm'");
+    R_ASSERT(styles.GetBrightness(4, 1000 / BspLightStyles::FramesPerSecond) == 0, "Fast strobe does not continue with 'a'");
+    R_ASSERT(styles.GetBrightness(20, 12345) == BspLightStyles::NormalBrightness, "Undefined style is not normal");
+
+    BspLightmapCompositor compositor(*tree, styles);
+    std::size_t blockCount = 0;
+    for(const auto& lightmap : tree->Lightmaps)
+        blockCount += lightmap.Blocks.size();
+
+    std::cout << "de_dust2.bsp:" << std::endl;
+    std::cout << "- Lightmap blocks: " << blockCount << std::endl;
+    R_ASSERT(compositor.GetDirtyBlocks().size() == blockCount, "Not every block was composited at the start");
+
+    // Same as scalar composition of every texel
+    const auto checkBlocks = [&tree, &compositor, &styles](uint64_t time_ms)
+    {
+        for(std::size_t page = 0; page < tree->Lightmaps.size(); page++)
+        {
+            const auto& lightmap = tree->Lightmaps[page];
+            for(const auto& block : lightmap.Blocks)
+            {
+                for(uint32_t y = block.Position.y; y < block.Position.y + block.Size.y; y++)
+                {
+                    for(uint32_t x = block.Position.x; x < block.Position.x + block.Size.x; x++)
+                    {
+                        const std::size_t texel = y * lightmap.Width + x;
+                        for(int c = 0; c < 3; c++)
+                        {
+                            uint32_t value = 0;
+                            for(std::size_t layer = 0; layer < lightmap.Layers.size() && block.Styles[layer] != BspFile::UnusedLightStyle; layer++)
+                                value += lightmap.Layers[layer][texel][c] * styles.GetBrightness(block.Styles[layer], time_ms);
+
+                            R_ASSERT(compositor.GetPages()[page][texel][c] == std::min<uint32_t>(value / 256, 255), "Composited texel is different at " << x << 'x' << y << " of page " << page);
+                        }
+                    }
+                }
+            }
+        }
+    };
+    checkBlocks(0);
+
+    // Nothing changed
+    R_ASSERT(compositor.Update(5000) == 0, "Blocks were composited without any change");
+
+    // Switch the normal style off and back on
+    styles.SetPattern(0, "a");
+    R_ASSERT(compositor.Update(5000) > 0, "Blocks of changed style were not composited");
+    checkBlocks(5000);
+    styles.SetPattern(0, BspLightStyles::BuiltInPatterns[0]);
+    R_ASSERT(compositor.Update(5100) > 0, "Blocks of changed style were not composited");
+    checkBlocks(5100);
+
+    // Odd sizes and every combination of brightness against the scalar version
+    std::array<uint8_t, 4 * 37> data;
+    for(std::size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(i * 97 + 13);
+    std::array<const uint8_t*, BspFile::MaxLightStyles> layers = { data.data(), data.data() + 37, data.data() + 74, data.data() + 111 };
+    for(uint16_t b : { 0, 1, 256, 264, 550 })
+    {
+        const std::array<uint16_t, BspFile::MaxLightStyles> brightness = { b, static_cast<uint16_t>(550 - b), b, 22 };
+        std::array<uint8_t, 37> out;
+        BspLightmapCompositor::Composite(layers, brightness, out.data(), out.size());
+        for(std::size_t i = 0; i < out.size(); i++)
+        {
+            uint32_t value = 0;
+            for(std::size_t l = 0; l < BspFile::MaxLightStyles; l++)
+                value += layers[l][i] * brightness[l];
+            R_ASSERT(out[i] == std::min<uint32_t>(value / 256, 255), "Composite differs from scalar version at " << i);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <map>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    auto tree = BspTree(bsp);
+
+    // Lightmap blocks are inside of their page, never overlap (unless shared) and have lightmap of every style in its layer
+    std::cout << "- Lightmap pages: " << tree.Lightmaps.size() << " (" << tree.Lightmaps[0].Width << 'x' << tree.Lightmaps[0].Height << ", " << tree.Lightmaps[0].Layers.size() << " layers)" << std::endl;
+    for(const auto& lightmap : tree.Lightmaps)
+    {
+        std::vector<bool> used(lightmap.Width * lightmap.Height);
+        std::set<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>> places;
+        for(const auto& block : lightmap.Blocks)
+        {
+            R_ASSERT(block.Position.x + block.Size.x <= lightmap.Width && block.Position.y + block.Size.y <= lightmap.Height, "Lightmap block is outside of its page");
+            R_ASSERT(block.Size == block.FaceSize || block.Size == glm::uvec2(1, 1), "Lightmap block has different size than its face");
+
+            const bool shared = !places.emplace(block.Position.x, block.Position.y, block.Size.x, block.Size.y).second;
+            for(uint32_t y = block.Position.y; y < block.Position.y + block.Size.y; y++)
+            {
+                for(uint32_t x = block.Position.x; x < block.Position.x + block.Size.x; x++)
+                {
+                    R_ASSERT(shared || !used[y * lightmap.Width + x], "Lightmap blocks overlap");
+                    used[y * lightmap.Width + x] = true;
+                }
+            }
+
+            const BspFile::Face& face = bsp->GetRawFaces()[block.Face];
+            const auto* lighting = reinterpret_cast<const glm::u8vec3*>(reinterpret_cast<const uint8_t*>(bsp->GetRawLighting()) + face.LightmapOffset);
+            for(std::size_t layer = 0; layer < BspFile::MaxLightStyles && block.Styles[layer] != BspFile::UnusedLightStyle; layer++)
+            {
+                R_ASSERT(layer < lightmap.Layers.size(), "Lightmap block has style without layer");
+                R_ASSERT(block.Styles[layer] == face.LightingStyles[layer], "Lightmap block has different style than its face");
+
+                // Collapsed block has a single colour, so the last texel is the same as the first one
+                const glm::u8vec3* styleLighting = lighting + layer * block.FaceSize.x * block.FaceSize.y;
+                const std::size_t last = (block.Position.y + block.Size.y - 1) * lightmap.Width + block.Position.x + block.Size.x - 1;
+                R_ASSERT(lightmap.Layers[layer][block.Position.y * lightmap.Width + block.Position.x] == styleLighting[0], "Lightmap block has wrong first texel");
+                R_ASSERT(lightmap.Layers[layer][last] == styleLighting[block.FaceSize.x * block.FaceSize.y - 1], "Lightmap block has wrong last texel");
+            }
+        }
+    }
+
+    // Every corner of a triangle uses the lightmap block (page and texels) of the triangle's face
+    {
+        std::map<uint32_t, std::pair<std::size_t, const BspTree::Lightmap::Block*>> faceBlocks;
+        for(std::size_t page = 0; page < tree.Lightmaps.size(); page++)
+        {
+            for(const auto& block : tree.Lightmaps[page].Blocks)
+                faceBlocks[block.Face] = { page, &block };
+        }
+
+        for(const auto& model : tree.Models)
+        {
+            for(std::size_t ti = 0; ti < model->TriangleFaces.size(); ti++)
+            {
+                const auto it = faceBlocks.find(model->TriangleFaces[ti]);
+                if(it == faceBlocks.end())
+                    continue;
+
+                for(std::size_t c = 0; c < 3; c++)
+                {
+                    const BspTree::Vertex& vertex = tree.Vertices[model->BaseVertex + model->Indices[ti * 3 + c]];
+                    R_ASSERT(vertex.LightmapPage == it->second.first, "Triangle corner uses different lightmap page than its face");
+
+                    // Texel centres of the block, like the engine samples them
+                    const auto& lightmap = tree.Lightmaps[it->second.first];
+                    const auto& block = *it->second.second;
+                    const glm::vec2 texel = vertex.LightUV * glm::vec2(lightmap.Width, lightmap.Height);
+                    R_ASSERT(
+                        texel.x >= block.Position.x + 0.5f - 0.01f && texel.x <= block.Position.x + block.Size.x - 0.5f + 0.01f &&
+                        texel.y >= block.Position.y + 0.5f - 0.01f && texel.y <= block.Position.y + block.Size.y - 0.5f + 0.01f,
+                        "Triangle corner has lightmap coordinates outside of its block"
+                    );
+                }
+            }
+        }
+    }
+
+    // Same lightmaps no matter how many threads packed them
+    {
+        auto serialTree = BspTree(bsp, 1);
+        R_ASSERT(serialTree.Lightmaps.size() == tree.Lightmaps.size(), "Serial build has different number of lightmap pages");
+        for(std::size_t page = 0; page < tree.Lightmaps.size(); page++)
+            R_ASSERT(serialTree.Lightmaps[page].Layers == tree.Lightmaps[page].Layers, "Serial build has different lightmap");
+    }
+}
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+
+using namespace Decay::Bsp::v30;
+
+/// Vertex cache misses per triangle with FIFO cache
+double AverageCacheMissRatio(const BspTree& tree, std::size_t cacheSize)
+{
+    std::size_t misses = 0;
+    std::size_t triangles = 0;
+    for(const auto& model : tree.Models)
+    {
+        std::deque<uint32_t> cache;
+        for(std::size_t i = 0; i < model->Indices.size(); i++)
+        {
+            const uint32_t index = model->Indices[i];
+            if(std::find(cache.begin(), cache.end(), index) != cache.end())
+                continue;
+
+            misses++;
+            cache.push_back(index);
+            if(cache.size() > cacheSize)
+                cache.pop_front();
+        }
+        triangles += model->Indices.size() / 3;
+    }
+    return triangles == 0 ? 0 : static_cast<double>(misses) / static_cast<double>(triangles);
+}
+
+typedef std::array<std::tuple<float, float, float>, 3> Triangle;
+
+/// [ model, texture, face ] = sorted triangles, corners start at the smallest one so winding is kept
+std::map<std::tuple<std::size_t, uint16_t, uint32_t>, std::vector<Triangle>> CollectTriangles(const BspTree& tree)
+{
+    std::map<std::tuple<std::size_t, uint16_t, uint32_t>, std::vector<Triangle>> triangles;
+    for(std::size_t mi = 0; mi < tree.Models.size(); mi++)
+    {
+        const auto& model = *tree.Models[mi];
+        for(const auto& range : model.TextureRanges)
+        {
+            for(std::size_t ii = range.Offset; ii < range.Offset + range.Count; ii += 3)
+            {
+                Triangle triangle;
+                for(std::size_t c = 0; c < 3; c++)
+                {
+                    const glm::vec3& position = tree.Vertices[model.BaseVertex + model.Indices[ii + c]].Position;
+                    triangle[c] = { position.x, position.y, position.z };
+                }
+                std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+
+                triangles[{ mi, range.TextureId, model.TriangleFaces[ii / 3] }].emplace_back(triangle);
+            }
+        }
+    }
+    for(auto& [key, list] : triangles)
+        std::sort(list.begin(), list.end());
+    return triangles;
+}
+
+int main()
+{
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+
+    BspTree tree(bsp);
+    const auto triangles = CollectTriangles(tree);
+    const double acmr = AverageCacheMissRatio(tree, 16);
+
+    BspTree optimized(bsp);
+    optimized.OptimizeMeshes(16);
+    const double optimizedAcmr = AverageCacheMissRatio(optimized, 16);
+
+    std::cout << "ACMR (16 vertices): " << acmr << " -> " << optimizedAcmr << std::endl;
+    R_ASSERT(optimizedAcmr <= acmr, "Optimized meshes use vertex cache worse");
+    R_ASSERT(CollectTriangles(optimized) == triangles, "Optimization changed triangles, their texture, face or winding");
+
+    for(const auto& model : optimized.Models)
+    {
+        // Same texture ranges, vertices in order of first use
+        uint32_t nextNew = 0;
+        for(std::size_t i = 0; i < model->Indices.size(); i++)
+        {
+            R_ASSERT(model->Indices[i] <= nextNew, "Vertices are not in order of first use");
+            if(model->Indices[i] == nextNew)
+                nextNew++;
+        }
+    }
+
+    // Result does not depend on number of threads
+    BspTree serial(bsp);
+    serial.OptimizeMeshes(16, 1);
+    R_ASSERT(serial.Vertices.size() == optimized.Vertices.size(), "Vertex count depends on thread count");
+    for(std::size_t i = 0; i < serial.Vertices.size(); i++)
+        R_ASSERT(serial.Vertices[i].Position == optimized.Vertices[i].Position, "Vertex order depends on thread count");
+    for(std::size_t mi = 0; mi < serial.Models.size(); mi++)
+        for(std::size_t i = 0; i < serial.Models[mi]->Indices.size(); i++)
+            R_ASSERT(serial.Models[mi]->Indices[i] == optimized.Models[mi]->Indices[i], "Index order depends on thread count");
+}
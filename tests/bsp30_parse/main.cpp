@@ -24,7 +24,24 @@ int main()
     std::cout << "- Vertices: " << tree.Vertices.size() << std::endl;
     std::cout << "- Textures: " << tree.Textures.size() << std::endl;
 
+    // Textures decoded on demand match fully decoded ones
+    {
+        auto textures = bsp->GetTextures();
+        R_ASSERT(textures.size() == tree.Textures.size(), "Texture count does not match");
+        for(std::size_t i = 0; i < textures.size(); i++)
+        {
+            R_ASSERT(textures[i].Name == tree.Textures[i].Name, "Texture name does not match");
+            R_ASSERT(textures[i].Size == tree.Textures[i].Size, "Texture size does not match");
+            R_ASSERT(textures[i].HasData() == tree.Textures[i].HasData(), "Texture data presence does not match");
+            if(!textures[i].HasData())
+                continue;
+
+            for(std::size_t level = 0; level < BspFile::MipTextureLevels; level++)
+                R_ASSERT(textures[i].AsRgba(level) == tree.GetTextureRgba(i, level), "Texture pixels do not match");
+        }
+    }
+
     auto mainModel = tree.Models[0];
     std::cout << "- Main Model: " << std::endl;
-    std::cout << "  - Textures used: " << mainModel->Indices.size() << " (top level)" << std::endl;
+    std::cout << "  - Textures used: " << mainModel->TextureRanges.size() << " (top level)" << std::endl;
 }
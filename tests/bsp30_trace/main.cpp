@@ -0,0 +1,76 @@
+#include <iostream>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspHulls.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    BspHulls hulls(bsp);
+
+    const BspFile::Model& world = bsp->GetMainModel();
+    const glm::vec3 size = world.bbMax - world.bbMin;
+
+    R_ASSERT(BspHulls::SelectHull(BspHulls::HullMins[1], BspHulls::HullMaxs[1]) == 1, "Standing player box should use hull 1");
+    R_ASSERT(BspHulls::SelectHull(BspHulls::HullMins[3], BspHulls::HullMaxs[3]) == 3, "Crouching player box should use hull 3");
+    R_ASSERT(BspHulls::SelectHull(BspHulls::HullMins[2], BspHulls::HullMaxs[2]) == 2, "Large box should use hull 2");
+    R_ASSERT(BspHulls::SelectHull({0, 0, 0}, {0, 0, 0}) == 0, "Point should use hull 0");
+    // Boxes up to 8 units wide (grenades, gibs...) still trace as a point
+    R_ASSERT(BspHulls::SelectHull({-4, -4, -4}, {4, 4, 4}) == 0, "8 units wide box should use hull 0");
+    R_ASSERT(BspHulls::SelectHull({-4.5f, -4.5f, -4.5f}, {4.5f, 4.5f, 4.5f}) == 3, "9 units wide box should use hull 3");
+    R_ASSERT(BspHulls::SelectHull({-4.5f, -4.5f, -18.5f}, {4.5f, 4.5f, 18.5f}) == 1, "9 units wide, 37 units tall box should use hull 1");
+    R_ASSERT(BspHulls::SelectHull({-18.5f, -18.5f, -18.5f}, {18.5f, 18.5f, 18.5f}) == 2, "37 units wide box should use hull 2");
+
+    // Outside of the world is solid
+    {
+        const glm::vec3 outside = world.bbMax + glm::vec3(1000);
+        R_ASSERT(hulls.PointContents(outside) == BspFile::LeafContent::Solid, "Point outside of the world is not solid");
+
+        const auto result = hulls.Trace(outside, outside + glm::vec3(0, 0, 100));
+        R_ASSERT(result.StartSolid && result.AllSolid, "Trace outside of the world does not start in solid space");
+    }
+
+    // Straight down from every open point on a grid, everything has to fall on a floor
+    std::vector<BspHulls::TraceRequest> requests;
+    constexpr int Steps = 24;
+    for(std::size_t hull = 0; hull < BspFile::MaxHulls; hull++)
+    {
+        for(int x = 1; x < Steps; x++)
+        {
+            for(int y = 1; y < Steps; y++)
+            {
+                for(int z = 1; z < Steps; z++)
+                {
+                    const glm::vec3 point = world.bbMin + size * glm::vec3(x, y, z) / static_cast<float>(Steps);
+                    if(hulls.PointContents(point, hull) != BspFile::LeafContent::Empty)
+                        continue;
+
+                    requests.push_back({ point, glm::vec3(point.x, point.y, world.bbMin.z - 1000), hull });
+                }
+            }
+        }
+    }
+    R_ASSERT(!requests.empty(), "No point is in open space");
+
+    std::vector<BspHulls::TraceResult> results(requests.size());
+    hulls.Trace(requests, results);
+
+    for(std::size_t i = 0; i < requests.size(); i++)
+    {
+        const BspHulls::TraceResult& result = results[i];
+        const BspHulls::TraceResult single = hulls.Trace(requests[i]);
+
+        R_ASSERT(result.Fraction == single.Fraction && result.EndPosition == single.EndPosition, "Batched and single trace " << i << " differ");
+        R_ASSERT(!result.StartSolid, "Trace " << i << " starts in open space but reports solid start");
+        R_ASSERT(result.Fraction < 1.0f, "Trace " << i << " fell out of the world");
+        R_ASSERT(result.PlaneNormal.z > 0, "Trace " << i << " hit a plane not facing up");
+        R_ASSERT(hulls.PointContents(result.EndPosition, requests[i].Hull) != BspFile::LeafContent::Solid, "Trace " << i << " ended inside of solid space");
+    }
+
+    std::cout << "de_dust2.bsp:" << std::endl;
+    std::cout << "- Traces: " << requests.size() << std::endl;
+
+    return 0;
+}
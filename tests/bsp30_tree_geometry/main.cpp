@@ -0,0 +1,267 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspTree.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    auto tree = BspTree(bsp);
+
+    // Every model uses its own continuous range of vertices
+    std::size_t nextVertex = 0;
+    for(const auto& model : tree.Models)
+    {
+        R_ASSERT(model->BaseVertex == nextVertex, "Model vertices do not follow previous model");
+        nextVertex += model->VertexCount;
+
+        const auto& indices = model->Indices;
+        R_ASSERT(indices.IsWide() == (model->VertexCount > BspTree::IndexBuffer::MaxNarrowVertices), "Model uses wrong index size");
+        R_ASSERT(model->TriangleFaces.size() * 3 == indices.size(), "Model does not have face for every triangle");
+        for(std::size_t i = 0; i < indices.size(); i++)
+            R_ASSERT(indices[i] < model->VertexCount, "Model index points outside of model vertices");
+
+        // Texture ranges are sorted and cover all indices
+        std::size_t nextIndex = 0;
+        for(std::size_t ri = 0; ri < model->TextureRanges.size(); ri++)
+        {
+            const auto& range = model->TextureRanges[ri];
+            R_ASSERT(range.Offset == nextIndex && range.Count > 0 && range.Count % 3 == 0, "Texture range does not follow previous range");
+            R_ASSERT(ri == 0 || model->TextureRanges[ri - 1].TextureId < range.TextureId, "Texture ranges are not sorted");
+            R_ASSERT(model->FindTexture(range.TextureId) == &range, "Texture range was not found");
+            nextIndex += range.Count;
+        }
+        R_ASSERT(nextIndex == indices.size(), "Texture ranges do not cover all indices");
+    }
+    R_ASSERT(nextVertex == tree.Vertices.size(), "Some vertices do not belong to any model");
+
+    // Brush models separated from the world belong to their entity
+    std::size_t brushEntities = 0;
+    for(std::size_t mi = 0; mi < tree.Models.size(); mi++)
+    {
+        const auto mesh = tree.GetModelMesh(mi);
+        const auto& model = *tree.Models[mi];
+        R_ASSERT(mesh.Source == tree.Models[mi] && mesh.Vertices.size() == model.VertexCount, "Model mesh does not match the model");
+
+        if(mesh.EntityIndex == BspEntities::NoEntity)
+        {
+            R_ASSERT(mesh.Origin == model.Origin, "Model without entity has different origin");
+            continue;
+        }
+        brushEntities++;
+        R_ASSERT(mi != 0, "World has an entity");
+        R_ASSERT(tree.Entities[mesh.EntityIndex].at("model") == "*" + std::to_string(mi), "Model mesh has wrong entity");
+
+        // Compiler moves vertices of entities with origin brush relative to their `origin`
+        glm::vec3 entityOrigin = {0, 0, 0};
+        if(const auto origin = tree.Entities[mesh.EntityIndex].find("origin"); origin != tree.Entities[mesh.EntityIndex].end())
+            std::istringstream(origin->second) >> entityOrigin.x >> entityOrigin.y >> entityOrigin.z;
+
+        for(std::size_t vi = 0; vi < mesh.Vertices.size(); vi++)
+        {
+            const glm::vec3 difference = mesh.Vertices[vi].Position + model.Origin - tree.Vertices[model.BaseVertex + vi].Position;
+            R_ASSERT(std::abs(difference.x) + std::abs(difference.y) + std::abs(difference.z) < 0.01f, "Model mesh vertex is not relative to model origin");
+
+            if(mesh.Angles == glm::vec3(0, 0, 0))
+            {
+                const glm::vec3 worldDifference = mesh.ToWorld(mesh.Vertices[vi].Position) - (tree.Vertices[model.BaseVertex + vi].Position + entityOrigin);
+                R_ASSERT(std::abs(worldDifference.x) + std::abs(worldDifference.y) + std::abs(worldDifference.z) < 0.01f, "Model mesh vertex without rotation does not map back to the world vertex");
+            }
+        }
+    }
+    std::cout << "- Brush entities: " << brushEntities << std::endl;
+
+    // Rotation comes from `angles` or `angle` (converted like the engine does),
+    // doors, buttons, triggers and breakables are spawned without rotation
+    for(std::size_t mi = 1; mi < tree.Models.size(); mi++)
+    {
+        const std::size_t entityIndex = tree.Entities.FindModelEntity(static_cast<int>(mi));
+        if(entityIndex == BspEntities::NoEntity)
+            continue;
+
+        const std::tuple<const char*, const char*, const char*, glm::vec3> cases[] = {
+            { "func_door", "angles", "0 90 0", {0, 0, 0} },
+            { "trigger_push", "angles", "0 90 0", {0, 0, 0} },
+            { "func_breakable", "angles", "0 90 0", {0, 0, 0} },
+            { "func_breakable", "angle", "90", {0, 0, 0} },
+            { "func_rotating", "angles", "0 90 0", {0, 90, 0} },
+            { "func_rotating", "angle", "90", {0, 90, 0} },
+            { "func_rotating", "angle", "-1", {-90, 0, 0} },
+            { "func_rotating", "angle", "-2", {90, 0, 0} },
+        };
+        for(const auto& [classname, key, value, expected] : cases)
+        {
+            std::ostringstream entities;
+            for(std::size_t ei = 0; ei < tree.Entities.size(); ei++)
+            {
+                BspEntities::Entity entity = tree.Entities[ei];
+                if(ei == entityIndex)
+                {
+                    entity.erase("angle");
+                    entity.erase("angles");
+                    entity["classname"] = classname;
+                    entity[key] = value;
+                }
+
+                entities << "{\n";
+                for(const auto& [k, v] : entity)
+                    entities << '"' << k << "\" \"" << v << "\"\n";
+                entities << "}\n";
+            }
+
+            auto bspEdited = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+            bspEdited->SetEntities(entities.str());
+            const auto mesh = BspTree(bspEdited).GetModelMesh(mi);
+            R_ASSERT(mesh.Angles == expected, classname << " with \"" << key << "\" \"" << value << "\" has wrong rotation");
+        }
+        break;
+    }
+    {
+        BspTree::ModelMesh mesh;
+        mesh.Angles = {0, 90, 0};
+        const glm::vec3 rotated = mesh.ToWorld({1, 0, 0});
+        R_ASSERT(std::abs(rotated.x) + std::abs(rotated.y - 1.0f) + std::abs(rotated.z) < 0.001f, "Yaw of 90 degrees does not rotate X axis to Y axis");
+    }
+
+    // Flat normals are the front of face planes, tangents are unit vectors along the faces
+    for(const auto& model : tree.Models)
+    {
+        for(std::size_t ti = 0; ti < model->TriangleFaces.size(); ti++)
+        {
+            const BspFile::Face& face = bsp->GetRawFaces()[model->TriangleFaces[ti]];
+            const glm::vec3 planeNormal = bsp->GetRawPlanes()[face.Plane].Normal;
+            const glm::vec3 normal = face.PlaneSide != 0 ? -planeNormal : planeNormal;
+
+            for(std::size_t c = 0; c < 3; c++)
+            {
+                const BspTree::Vertex& vertex = tree.Vertices[model->BaseVertex + model->Indices[ti * 3 + c]];
+                const glm::vec3 tangent = glm::vec3(vertex.Tangent.x, vertex.Tangent.y, vertex.Tangent.z);
+                R_ASSERT(vertex.Normal == normal, "Vertex normal is not normal of its face");
+                R_ASSERT(std::abs(glm::length(tangent) - 1) < 0.001f && std::abs(glm::dot(tangent, normal)) < 0.001f, "Vertex tangent is not along its face");
+                R_ASSERT(vertex.Tangent.w == 1 || vertex.Tangent.w == -1, "Vertex tangent does not have handedness");
+            }
+        }
+    }
+
+    // Coplanar faces with different texture S axes meeting at a vertex with same UV keep their own tangents
+    {
+        auto bspRotated = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+        const auto faceCorners = [&bspRotated](const BspFile::Face& face)
+        {
+            std::vector<glm::vec3> corners;
+            for(std::size_t sei = face.FirstSurfaceEdge; sei < face.FirstSurfaceEdge + face.SurfaceEdgeCount; sei++)
+            {
+                const BspFile::SurfaceEdges surfaceEdge = bspRotated->GetSurfaceEdges()[sei];
+                const auto& edge = bspRotated->GetEdges()[std::abs(surfaceEdge)];
+                corners.push_back(bspRotated->GetVertices()[surfaceEdge >= 0 ? edge.First : edge.Second]);
+            }
+            return corners;
+        };
+        // Whole numbers keep texture coordinates exact, so both faces get exactly the same UV
+        const auto isWhole = [](const glm::vec3& v) { return v == glm::floor(v); };
+
+        std::size_t faceA = 0, faceB = 0;
+        glm::vec3 shared = {0, 0, 0};
+        const auto faces = bspRotated->GetFaces();
+        for(std::size_t a = 0; a < faces.size() && faceA == faceB; a++)
+        {
+            const BspFile::TextureMapping& mapping = bspRotated->GetTextureMapping()[faces[a].TextureMapping];
+            if(!isWhole(mapping.S) || !isWhole(mapping.T) || mapping.SShift != std::floor(mapping.SShift) || mapping.TShift != std::floor(mapping.TShift))
+                continue;
+
+            const auto cornersA = faceCorners(faces[a]);
+            for(std::size_t b = a + 1; b < faces.size() && faceA == faceB; b++)
+            {
+                if(faces[b].Plane != faces[a].Plane || faces[b].PlaneSide != faces[a].PlaneSide)
+                    continue;
+                for(const glm::vec3& corner : faceCorners(faces[b]))
+                {
+                    if(isWhole(corner) && std::find(cornersA.begin(), cornersA.end(), corner) != cornersA.end())
+                    {
+                        faceA = a;
+                        faceB = b;
+                        shared = corner;
+                        break;
+                    }
+                }
+            }
+        }
+        R_ASSERT(faceA != faceB, "BSP has no coplanar faces sharing a vertex");
+
+        // Face B gets texture mapping of face A rotated by 90 degrees, shifted to the same UV at the shared vertex
+        const BspFile::TextureMapping mappingA = bspRotated->GetTextureMapping()[faces[faceA].TextureMapping];
+        const std::size_t mappingIndexB = faces[faceB].TextureMapping != faces[faceA].TextureMapping ? faces[faceB].TextureMapping : (faces[faceA].TextureMapping + 1) % bspRotated->GetTextureMappingCount();
+        R_ASSERT(mappingIndexB != faces[faceA].TextureMapping, "BSP has only one texture mapping");
+        BspFile::TextureMapping& mappingB = bspRotated->GetTextureMapping()[mappingIndexB];
+        mappingB = mappingA;
+        mappingB.S = mappingA.T;
+        mappingB.T = -mappingA.S;
+        mappingB.SShift = mappingA.GetTexelS(shared) - glm::dot(mappingB.S, shared);
+        mappingB.TShift = mappingA.GetTexelT(shared) - glm::dot(mappingB.T, shared);
+        R_ASSERT(mappingB.GetTexelS(shared) == mappingA.GetTexelS(shared) && mappingB.GetTexelT(shared) == mappingA.GetTexelT(shared), "Rotated mapping has different UV at the shared vertex");
+        faces[faceB].TextureMapping = static_cast<uint16_t>(mappingIndexB);
+
+        // Without lightmaps both faces have the same lightmap coordinates
+        faces[faceA].LightmapOffset = -1;
+        faces[faceB].LightmapOffset = -1;
+
+        auto rotatedTree = BspTree(bspRotated);
+        std::size_t checkedCorners = 0;
+        for(const auto& model : rotatedTree.Models)
+        {
+            for(std::size_t ti = 0; ti < model->TriangleFaces.size(); ti++)
+            {
+                const uint32_t face = model->TriangleFaces[ti];
+                if(face != faceA && face != faceB)
+                    continue;
+
+                const glm::vec3 planeNormal = bspRotated->GetPlanes()[faces[face].Plane].Normal;
+                const glm::vec3 normal = faces[face].PlaneSide != 0 ? -planeNormal : planeNormal;
+                const glm::vec3 s = bspRotated->GetTextureMapping()[faces[face].TextureMapping].S;
+                const glm::vec3 expected = glm::normalize(s - normal * glm::dot(normal, s));
+                for(std::size_t c = 0; c < 3; c++)
+                {
+                    const BspTree::Vertex& vertex = rotatedTree.Vertices[model->BaseVertex + model->Indices[ti * 3 + c]];
+                    R_ASSERT(glm::dot(glm::vec3(vertex.Tangent.x, vertex.Tangent.y, vertex.Tangent.z), expected) > 0.999f, "Vertex of face " << face << " has tangent of another face");
+                    checkedCorners++;
+                }
+            }
+        }
+        R_ASSERT(checkedCorners >= 6, "Rotated faces have no triangles");
+    }
+
+    // Smoothed normals are unit vectors, equal vertices still share the same normal
+    {
+        auto smoothTree = BspTree(bsp, 0, 60);
+        auto serialSmoothTree = BspTree(bsp, 1, 60);
+        R_ASSERT(serialSmoothTree.Vertices.size() == smoothTree.Vertices.size(), "Serial smoothing has different vertex count");
+        R_ASSERT(std::memcmp(serialSmoothTree.Vertices.data(), smoothTree.Vertices.data(), smoothTree.Vertices.size() * sizeof(BspTree::Vertex)) == 0, "Serial smoothing has different vertices");
+        for(const auto& vertex : smoothTree.Vertices)
+            R_ASSERT(std::abs(glm::length(vertex.Normal) - 1) < 0.001f, "Smoothed normal is not unit vector");
+    }
+
+    // Same result no matter how many threads prepared the faces
+    {
+        auto serialTree = BspTree(bsp, 1);
+        R_ASSERT(serialTree.Vertices.size() == tree.Vertices.size(), "Serial build has different vertex count");
+        R_ASSERT(std::memcmp(serialTree.Vertices.data(), tree.Vertices.data(), tree.Vertices.size() * sizeof(BspTree::Vertex)) == 0, "Serial build has different vertices");
+
+        for(std::size_t mi = 0; mi < tree.Models.size(); mi++)
+        {
+            const auto& model = *tree.Models[mi];
+            const auto& serialModel = *serialTree.Models[mi];
+            R_ASSERT(serialModel.TextureRanges.size() == model.TextureRanges.size(), "Serial build of model " << mi << " uses different textures");
+            R_ASSERT(serialModel.Indices.size() == model.Indices.size(), "Serial build of model " << mi << " has different index count");
+            for(std::size_t i = 0; i < model.Indices.size(); i++)
+                R_ASSERT(serialModel.Indices[i] == model.Indices[i], "Serial build of model " << mi << " has different indices");
+            R_ASSERT(serialModel.TriangleFaces == model.TriangleFaces, "Serial build of model " << mi << " has different faces");
+        }
+    }
+}
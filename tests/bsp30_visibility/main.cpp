@@ -0,0 +1,53 @@
+#include <iostream>
+
+#include "Decay/Bsp/v30/BspFile.hpp"
+#include "Decay/Bsp/v30/BspVisibility.hpp"
+
+int main()
+{
+    using namespace Decay::Bsp::v30;
+
+    auto bsp = std::make_shared<BspFile>("../../../half-life/cstrike/maps/de_dust2.bsp");
+    BspVisibility lazyVis(bsp);
+    BspVisibility fullVis(bsp, true);
+
+    std::cout << "de_dust2.bsp:" << std::endl;
+    std::cout << "- Visible leaves: " << fullVis.LeafCount << std::endl;
+    R_ASSERT(fullVis.LeafCount > 0, "Map has no visibility information");
+
+    R_ASSERT(!fullVis.IsVisible(0, 1), "Solid leaf cannot see anything");
+    R_ASSERT(!fullVis.IsVisible(1, 0), "Solid leaf cannot be seen");
+
+    std::size_t totalVisible = 0;
+    for(std::size_t leaf = 1; leaf <= fullVis.LeafCount; leaf++)
+    {
+        const auto lazyRow = lazyVis.GetRow(leaf);
+        const auto fullRow = fullVis.GetRow(leaf);
+        R_ASSERT(std::equal(lazyRow.begin(), lazyRow.end(), fullRow.begin(), fullRow.end()), "Lazy and full decompression of leaf " << leaf << " differ");
+
+        const auto visible = fullVis.VisibleLeaves(leaf);
+        R_ASSERT(visible.size() == fullVis.CountVisible(leaf), "Visible leaf count of leaf " << leaf << " does not match");
+        for(uint32_t other : visible)
+            R_ASSERT(fullVis.IsVisible(leaf, other), "Leaf " << other << " was listed but is not visible from " << leaf);
+
+        totalVisible += visible.size();
+    }
+    std::cout << "- Average PVS size: " << (totalVisible / fullVis.LeafCount) << std::endl;
+
+    std::vector<uint32_t> leaves;
+    for(uint32_t leaf = 1; leaf <= fullVis.LeafCount; leaf += 7)
+        leaves.emplace_back(leaf);
+
+    const auto united = fullVis.Union(leaves);
+    const auto intersected = fullVis.Intersection(leaves);
+    for(uint32_t leaf : leaves)
+    {
+        fullVis.ForEachVisibleLeaf(leaf, [&](uint32_t other)
+        {
+            R_ASSERT((united[(other - 1) / 64] >> ((other - 1) % 64)) & 1u, "Union is missing leaf " << other);
+        });
+    }
+    R_ASSERT(BspVisibility::Count(intersected) <= BspVisibility::Count(united), "Intersection is larger than union");
+
+    return 0;
+}